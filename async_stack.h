@@ -0,0 +1,173 @@
+#ifndef ASYNC_STACK_H
+#define ASYNC_STACK_H
+
+#include "call_site.h"
+
+#include <cstddef>
+
+#if defined(TOBY_ASYNC_STACK)
+#include <atomic>
+#include <ostream>
+#include <vector>
+#endif
+
+/*!
+= Async stacks
+
+A coroutine run by monad_promise is resumed from inside the bind of whatever
+it awaited, so the native stack at any point shows continuations and resume
+functions rather than which coroutine is awaiting which. When
+TOBY_ASYNC_STACK is defined, monad_promise keeps a logical stack alongside it:
+each thread has a pointer to the innermost `async_frame`, and each of those
+links to its parent.
+
+There are two kinds of entry. A running coroutine has one for as long as it
+runs, from being created or resumed until it next suspends, with the co_await
+it was resumed from. A coroutine that is inside the bind of one of its
+co_awaits has one for that co_await, so that a coroutine resumed synchronously
+by the bind, as expected's bind does, is seen to be called from it. For
+monads whose bind runs the awaited computation later, such as State, a resumed
+coroutine's parent is whatever is running at the time, which is usually the
+code that ran the computation.
+
+`capture()` copies the logical stack into a buffer without allocating or
+locking, so that it can be called from a sampling profiler's signal handler.
+
+When TOBY_ASYNC_STACK isn't defined, nothing is kept, and the functions that
+read the stack aren't declared. It must be defined, or not, consistently
+across a program.
+*/
+
+namespace toby::async_stack {
+#if defined(TOBY_ASYNC_STACK)
+  inline constexpr bool enabled = true;
+#else
+  inline constexpr bool enabled = false;
+#endif
+
+  struct async_frame {
+    async_frame const* parent = nullptr;
+    // The address of the coroutine frame, as given by coroutine_handle.
+    void const* frame = nullptr;
+    // For a running coroutine, the co_await that it was last resumed from,
+    // which is empty until its first resumption; for an awaiting one, the
+    // co_await that it is in.
+    call_site site;
+    bool awaiting = false;
+  };
+
+  // The entry of a running coroutine, which monad_promise derives from so
+  // that it takes no space when async stacks are disabled.
+  template <bool = enabled>
+  struct activation {
+    void activate(void const*, async_frame const*) noexcept {}
+    void deactivate() noexcept {}
+  };
+
+  // The entry of a coroutine inside the bind of a co_await, which
+  // monad_awaitable derives from.
+  template <bool = enabled>
+  struct awaiting {
+    struct bind_scope {};
+
+    constexpr explicit awaiting(call_site) {}
+    bind_scope enter(void const*) noexcept { return {}; }
+    async_frame const* entry() const noexcept { return nullptr; }
+  };
+
+#if defined(TOBY_ASYNC_STACK)
+  namespace detail {
+    inline thread_local async_frame const* current = nullptr;
+
+    // The fences keep the compiler from reordering the writes to a frame with
+    // the write that publishes it, as a signal handler may run between them.
+    inline void set_current(async_frame const* f) noexcept {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      current = f;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+  }  // namespace detail
+
+  // The innermost frame of this thread's logical stack.
+  inline async_frame const* current() noexcept { return detail::current; }
+
+  // Copies up to max frames of this thread's logical stack into out, innermost
+  // first, and returns how many were copied. This is async-signal-safe.
+  inline std::size_t capture(async_frame* out, std::size_t max) noexcept {
+    std::size_t n = 0;
+    for (auto f = current(); f && n < max; f = f->parent) out[n++] = *f;
+    return n;
+  }
+
+  // This thread's logical stack, innermost first.
+  inline std::vector<async_frame> stack() {
+    std::vector<async_frame> result;
+    for (auto f = current(); f; f = f->parent) result.push_back(*f);
+    return result;
+  }
+
+  inline void print(std::ostream& os) {
+    for (auto const& f : stack()) {
+      os << f.frame << (f.awaiting ? " awaiting at " : " running");
+      if (f.site.file) {
+        os << (f.awaiting ? "" : " from ") << f.site.function << " ("
+           << f.site.file << ':' << f.site.line << ')';
+      }
+      os << '\n';
+    }
+  }
+
+  template <>
+  struct activation<true> {
+    async_frame node;
+
+    // Called when the coroutine with the given frame starts running, having
+    // been resumed from the co_await with the given entry, if any. If that
+    // co_await's bind resumed it, the coroutine replaces the entry, rather than
+    // appearing twice.
+    void activate(void const* frame, async_frame const* from) noexcept {
+      auto parent = current();
+      if (from && parent == from) parent = from->parent;
+      node.parent = parent;
+      node.frame = frame;
+      node.site = from ? from->site : call_site{};
+      detail::set_current(&node);
+    }
+
+    void deactivate() noexcept { detail::set_current(node.parent); }
+  };
+
+  template <>
+  struct awaiting<true> {
+    async_frame node;
+    async_frame const* previous = nullptr;
+
+    explicit awaiting(call_site site) {
+      node.site = site;
+      node.awaiting = true;
+    }
+
+    // The time spent in the bind, which ends when it is destroyed, so that a
+    // bind that throws still leaves the stack as it found it.
+    struct bind_scope {
+      awaiting& a;
+
+      bind_scope(bind_scope const&) = delete;
+      bind_scope& operator=(bind_scope const&) = delete;
+      ~bind_scope() { detail::set_current(a.previous); }
+    };
+
+    [[nodiscard]] bind_scope enter(void const* frame) noexcept {
+      previous = current();
+      node.parent = previous;
+      node.frame = frame;
+      detail::set_current(&node);
+      return {*this};
+    }
+
+    async_frame const* entry() const noexcept { return &node; }
+  };
+#endif
+}  // namespace toby::async_stack
+
+#endif  // ASYNC_STACK_H
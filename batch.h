@@ -0,0 +1,235 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "state.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*!
+= Batched State
+
+Running the same `RawState` program for many independent initial states one at
+a time leaves most of the machine idle. `run_batch` instead runs the program
+once per group of `W` states, with the state being a `batch<S, W>`: `W` lanes
+of `S` on which arithmetic is applied lane-wise, in loops that the compiler
+vectorizes.
+
+Nothing about `pure`, `get`, `put`, `transform` or `bind` needs to change for
+this: because they are generic in the state type, running a program on a
+`batch<S, W>` lowers each of them to the lane-parallel operation. The functions
+passed to `bind` and `transform` must be generic too (taking `auto` rather than
+`S`), and they must not branch on the values they are given, since each value
+is a whole batch; use `select` instead.
+*/
+
+namespace toby {
+  namespace detail {
+    // The smallest power of two that is at least n, as alignas requires one.
+    constexpr std::size_t ceil_pow2(std::size_t n) {
+      std::size_t p = 1;
+      while (p < n) p *= 2;
+      return p;
+    }
+  }  // namespace detail
+
+  template <typename T, std::size_t W>
+  struct batch {
+    static_assert(std::is_arithmetic_v<T>,
+                  "batch lanes must be of arithmetic type");
+
+    alignas(detail::ceil_pow2(alignof(T) * W)) T lanes[W];
+
+    static constexpr std::size_t width = W;
+
+    static constexpr batch broadcast(T x) {
+      batch r{};
+      for (std::size_t i = 0; i < W; ++i) r.lanes[i] = x;
+      return r;
+    }
+
+    constexpr T& operator[](std::size_t i) { return lanes[i]; }
+    constexpr T const& operator[](std::size_t i) const { return lanes[i]; }
+  };
+
+  template <typename T>
+  struct is_batch : std::false_type {};
+  template <typename T, std::size_t W>
+  struct is_batch<batch<T, W>> : std::true_type {};
+
+  // The type of one lane of T, which is T itself unless T is a batch.
+  template <typename T>
+  struct lane_type {
+    using type = T;
+  };
+  template <typename T, std::size_t W>
+  struct lane_type<batch<T, W>> {
+    using type = T;
+  };
+
+  // The default number of lanes: enough to fill a 64-byte vector register.
+  template <typename T>
+  inline constexpr std::size_t batch_width =
+      64 / sizeof(T) ? 64 / sizeof(T) : 1;
+
+  template <typename T>
+  constexpr T const& lane(T const& x, std::size_t) {
+    return x;
+  }
+  template <typename T, std::size_t W>
+  constexpr T const& lane(batch<T, W> const& x, std::size_t i) {
+    return x.lanes[i];
+  }
+
+  // Whether A and B can be combined lane-wise: at least one of them is a batch
+  // and the other is a batch of the same width or a scalar. If so, width is
+  // the number of lanes of the result.
+  template <typename A, typename B>
+  struct lanewise_traits {
+    static constexpr bool value = false;
+  };
+  template <typename T, std::size_t W, typename B>
+  struct lanewise_traits<batch<T, W>, B> {
+    static constexpr bool value = std::is_arithmetic_v<B>;
+    static constexpr std::size_t width = W;
+  };
+  template <typename A, typename T, std::size_t W>
+  struct lanewise_traits<A, batch<T, W>> {
+    static constexpr bool value = std::is_arithmetic_v<A>;
+    static constexpr std::size_t width = W;
+  };
+  template <typename T, typename U, std::size_t W>
+  struct lanewise_traits<batch<T, W>, batch<U, W>> {
+    static constexpr bool value = true;
+    static constexpr std::size_t width = W;
+  };
+
+  template <typename A, typename B>
+  using enable_lanewise_t = std::enable_if_t<lanewise_traits<A, B>::value>;
+
+  template <typename A, typename B, typename Op>
+  constexpr auto lanewise(A const& a, B const& b, Op op) {
+    constexpr auto W = lanewise_traits<A, B>::width;
+    using R = decltype(op(lane(a, 0), lane(b, 0)));
+    batch<R, W> r{};
+    for (std::size_t i = 0; i < W; ++i) {
+      r.lanes[i] = op(lane(a, i), lane(b, i));
+    }
+    return r;
+  }
+
+#define TOBY_BATCH_BINARY_OPERATOR(op)                                  \
+  template <typename A, typename B, typename = enable_lanewise_t<A, B>> \
+  constexpr auto operator op(A const& a, B const& b) {                  \
+    return lanewise(a, b, [](auto x, auto y) { return x op y; });       \
+  }
+
+#define TOBY_BATCH_ASSIGNMENT_OPERATOR(op)                                     \
+  template <typename T, std::size_t W, typename B,                             \
+            typename = enable_lanewise_t<batch<T, W>, B>>                      \
+  constexpr batch<T, W>& operator op##=(batch<T, W>& a, B const& b) {          \
+    for (std::size_t i = 0; i < W; ++i) a.lanes[i] = a.lanes[i] op lane(b, i); \
+    return a;                                                                  \
+  }
+
+  TOBY_BATCH_BINARY_OPERATOR(+)
+  TOBY_BATCH_BINARY_OPERATOR(-)
+  TOBY_BATCH_BINARY_OPERATOR(*)
+  TOBY_BATCH_BINARY_OPERATOR(/)
+  TOBY_BATCH_BINARY_OPERATOR(%)
+  TOBY_BATCH_BINARY_OPERATOR(&)
+  TOBY_BATCH_BINARY_OPERATOR(|)
+  TOBY_BATCH_BINARY_OPERATOR(^)
+  TOBY_BATCH_BINARY_OPERATOR(<<)
+  TOBY_BATCH_BINARY_OPERATOR(>>)
+  TOBY_BATCH_BINARY_OPERATOR(==)
+  TOBY_BATCH_BINARY_OPERATOR(!=)
+  TOBY_BATCH_BINARY_OPERATOR(<)
+  TOBY_BATCH_BINARY_OPERATOR(<=)
+  TOBY_BATCH_BINARY_OPERATOR(>)
+  TOBY_BATCH_BINARY_OPERATOR(>=)
+
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(+)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(-)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(*)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(/)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(%)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(&)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(|)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(^)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(<<)
+  TOBY_BATCH_ASSIGNMENT_OPERATOR(>>)
+
+#undef TOBY_BATCH_BINARY_OPERATOR
+#undef TOBY_BATCH_ASSIGNMENT_OPERATOR
+
+  template <typename T, std::size_t W>
+  constexpr auto operator-(batch<T, W> const& a) {
+    batch<T, W> r{};
+    for (std::size_t i = 0; i < W; ++i) r.lanes[i] = -a.lanes[i];
+    return r;
+  }
+
+  // The lane-wise equivalent of `mask ? a : b`.
+  template <typename M, typename A, typename B>
+  constexpr auto select(M const& mask, A const& a, B const& b) {
+    if constexpr (is_batch<M>::value) {
+      using R = std::common_type_t<typename lane_type<A>::type,
+                                   typename lane_type<B>::type>;
+      batch<R, M::width> r{};
+      for (std::size_t i = 0; i < M::width; ++i) {
+        r.lanes[i] = lane(mask, i) ? R(lane(a, i)) : R(lane(b, i));
+      }
+      return r;
+    } else {
+      return mask ? a : b;
+    }
+  }
+}  // namespace toby
+
+namespace toby::state {
+  // Runs m once for each of states, W at a time, returning the results and the
+  // final states in the same order. The result of m may be a batch, or a
+  // scalar that is the same for every lane.
+  template <std::size_t W = 0, typename M, typename S>
+  auto run_batch(M const& m, std::vector<S> const& states) {
+    constexpr auto width = W ? W : batch_width<S>;
+    using lanes = batch<S, width>;
+    using D = decltype(m.run(std::declval<lanes>()).data);
+    using A = typename lane_type<D>::type;
+
+    RunResult<std::vector<A>, std::vector<S>> result{
+        std::vector<A>(states.size()), std::vector<S>(states.size())};
+    auto run_lanes = [&](std::size_t base, lanes in, std::size_t n) {
+      auto out = m.run(std::move(in));
+      for (std::size_t i = 0; i < n; ++i) {
+        if constexpr (is_batch<D>::value) {
+          result.data[base + i] = out.data.lanes[i];
+        } else {
+          result.data[base + i] = out.data;
+        }
+        result.state[base + i] = out.state.lanes[i];
+      }
+    };
+    auto full = states.size() - states.size() % width;
+    for (std::size_t base = 0; base < full; base += width) {
+      lanes in;
+      for (std::size_t i = 0; i < width; ++i) in.lanes[i] = states[base + i];
+      run_lanes(base, in, width);
+    }
+    if (auto n = states.size() - full) {
+      // Pad the partial final batch by repeating its last state.
+      lanes in;
+      for (std::size_t i = 0; i < width; ++i) {
+        in.lanes[i] = states[full + std::min(i, n - 1)];
+      }
+      run_lanes(full, in, n);
+    }
+    return result;
+  }
+}  // namespace toby::state
+
+#endif  // BATCH_H
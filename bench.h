@@ -0,0 +1,70 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// A minimal benchmark harness. Benchmarks are registered with the BENCHMARK
+// macro and run by bench_main.cpp, which reports the time taken and the number
+// of heap allocations made per operation.
+
+#include <cstddef>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace bench {
+  // The body of a benchmark performs the operation being measured `iterations`
+  // times.
+  using body = void (*)(std::size_t iterations);
+
+  struct registration {
+    char const* name;
+    body run;
+    // How many operations each iteration of the body counts as, so that
+    // results can be reported per co_await rather than per coroutine, say.
+    std::size_t ops_per_iteration;
+  };
+
+  std::vector<registration>& registry();
+
+  struct registrar {
+    registrar(char const* name, body run, std::size_t ops_per_iteration) {
+      registry().push_back({name, run, ops_per_iteration});
+    }
+  };
+
+  // Prevents the compiler from optimizing away the computation of a value that
+  // is otherwise unused.
+  template <typename T>
+  void keep(T const& x) {
+#if defined(_MSC_VER)
+    static void const* volatile sink;
+    sink = &x;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "g"(&x) : "memory");
+#endif
+  }
+
+  // The number of calls to the global operator new made by the program so far.
+  std::size_t allocations();
+
+  // Reports the time that a call of the body took, in seconds, in place of
+  // the time measured around the call, for a body that hands its work to
+  // other threads and times only that work.
+  void report_time(double seconds);
+}  // namespace bench
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+
+#define BENCHMARK_OPS(name, ops) \
+  BENCHMARK_IMPL(name, ops, BENCH_CONCAT(bench_body_, __LINE__))
+#define BENCHMARK(name) BENCHMARK_OPS(name, 1)
+
+#define BENCHMARK_IMPL(name, ops, fn)                                     \
+  static void fn(std::size_t iterations);                                 \
+  static ::bench::registrar BENCH_CONCAT(fn, _registrar){name, &fn, ops}; \
+  static void fn(std::size_t iterations)
+
+#endif  // BENCH_H
@@ -0,0 +1,51 @@
+#include "batch.h"
+
+#include "bench.h"
+
+namespace {
+  auto const next_random = toby::state::get >>= [](auto s) {
+    return toby::state::put(s * 1103515245u + 12345u) >>=
+           [=](auto&&) { return toby::state::pure((s >> 16) & 0x7fffu); };
+  };
+
+  // A scoring rule over three random numbers, branch-free so that it can be
+  // batched.
+  auto const score = next_random >>= [](auto x) {
+    return next_random >>= [=](auto y) {
+      return toby::state::transform(next_random, [=](auto z) {
+        return toby::select(x + y > z, x + y - z, z - x - y);
+      });
+    };
+  };
+
+  constexpr std::size_t seeds = 1 << 16;
+
+  std::vector<unsigned> make_seeds() {
+    std::vector<unsigned> r(seeds);
+    for (std::size_t i = 0; i < seeds; ++i) r[i] = unsigned(i * 7919);
+    return r;
+  }
+}  // namespace
+
+BENCHMARK_OPS("batch/scalar loop over run (per seed)", seeds) {
+  auto states = make_seeds();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    std::vector<unsigned> data(states.size());
+    for (std::size_t j = 0; j < states.size(); ++j) {
+      auto r = score.run(states[j]);
+      data[j] = r.data;
+      states[j] = r.state;
+    }
+    bench::keep(data);
+  }
+  bench::keep(states);
+}
+
+BENCHMARK_OPS("batch/run_batch (per seed)", seeds) {
+  auto states = make_seeds();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto r = toby::state::run_batch(score, states);
+    bench::keep(r.data);
+    states = std::move(r.state);
+  }
+}
@@ -0,0 +1,77 @@
+#include "expected.h"
+
+#include "bench.h"
+
+using std::experimental::expected;
+using std::experimental::make_unexpected;
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  // A chain of four steps, the first of which fails for inputs that are a
+  // multiple of `every`.
+  expected<int, error> start(int i, int every) {
+    if (i % every == 0) return make_unexpected(error{i});
+    return i;
+  }
+
+  auto const widen = [](int x) -> expected<long, error> { return long(x) * 3; };
+  auto const offset = [](long x) -> expected<long, error> { return x + 1; };
+  auto const scale = [](long x) -> expected<double, error> {
+    return double(x) * 0.5;
+  };
+
+  expected<double, error> chain_manual(int i, int every) {
+    auto a = start(i, every);
+    if (!a) return make_unexpected(a.error());
+    auto b = widen(*a);
+    if (!b) return make_unexpected(b.error());
+    auto c = offset(*b);
+    if (!c) return make_unexpected(c.error());
+    return scale(*c);
+  }
+
+  expected<double, error> chain_bind(int i, int every) {
+    return start(i, every).bind(widen).bind(offset).bind(scale);
+  }
+
+  expected<double, error> chain_fused(int i, int every) {
+    return ((start(i, every) >>= widen) >>= offset) >>= scale;
+  }
+
+  template <typename F>
+  void run_chain(F f, int every, std::size_t iterations) {
+    // Hide every from the optimizer so that the failures aren't predictable at
+    // compile time.
+    bench::keep(every);
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(f(int(i), every));
+    }
+  }
+}  // namespace
+
+BENCHMARK("expected/manual chain, rarely failing") {
+  run_chain(chain_manual, 64, iterations);
+}
+
+BENCHMARK("expected/.bind chain, rarely failing") {
+  run_chain(chain_bind, 64, iterations);
+}
+
+BENCHMARK("expected/fused >>= chain, rarely failing") {
+  run_chain(chain_fused, 64, iterations);
+}
+
+BENCHMARK("expected/manual chain, failing at the first step") {
+  run_chain(chain_manual, 1, iterations);
+}
+
+BENCHMARK("expected/.bind chain, failing at the first step") {
+  run_chain(chain_bind, 1, iterations);
+}
+
+BENCHMARK("expected/fused >>= chain, failing at the first step") {
+  run_chain(chain_fused, 1, iterations);
+}
@@ -0,0 +1,183 @@
+#include "bench.h"
+#include "bench_perf.h"
+
+#include "compiler.h"
+#include "frame_census.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace {
+  // Allocations are counted in several counters, each on a cache line of its
+  // own, with each thread using one of them, so that counting doesn't make
+  // the threads of the scaling benchmarks contend for a single counter.
+  struct alignas(64) allocation_counter {
+    std::atomic<std::size_t> count{0};
+  };
+
+  constexpr unsigned allocation_counter_count = 64;
+  allocation_counter allocation_counts[allocation_counter_count];
+  std::atomic<unsigned> allocating_threads{0};
+
+  allocation_counter& local_allocation_counter() {
+    thread_local unsigned index =
+        allocating_threads.fetch_add(1, std::memory_order_relaxed) %
+        allocation_counter_count;
+    return allocation_counts[index];
+  }
+
+  // The time reported by the body being run, if it reported one.
+  double reported_time = -1;
+
+  // Runs a benchmark body for long enough to get a stable measurement. If
+  // counters is given, also reports the hardware counters that are available
+  // per operation, on a line of their own.
+  void run_one(bench::registration const& r,
+               double min_seconds,
+               bench::perf::counters* counters) {
+    using clock = std::chrono::steady_clock;
+    std::size_t iterations = 1;
+    for (;;) {
+      auto allocs_before = bench::allocations();
+      if (counters) counters->start();
+      reported_time = -1;
+      auto start = clock::now();
+      r.run(iterations);
+      std::chrono::duration<double> elapsed = clock::now() - start;
+      if (reported_time >= 0) {
+        elapsed = std::chrono::duration<double>(reported_time);
+      }
+      bench::perf::reading counts;
+      if (counters) counts = counters->stop();
+      auto allocs = bench::allocations() - allocs_before;
+      if (elapsed.count() >= min_seconds ||
+          iterations >= (std::size_t(1) << 40)) {
+        double ops = double(iterations) * double(r.ops_per_iteration);
+        std::printf("%-64s %12.2f ns/op %10.2f allocs/op %14zu ops\n", r.name,
+                    elapsed.count() * 1e9 / ops, double(allocs) / ops,
+                    std::size_t(ops));
+        if (counters) {
+          std::printf("%-64s", "");
+          for (std::size_t i = 0; i < bench::perf::counter_count; ++i) {
+            if (counts[i] < 0) {
+              std::printf(" %8s %s/op", "-", bench::perf::names[i]);
+            } else {
+              std::printf(" %8.2f %s/op", counts[i] / ops,
+                          bench::perf::names[i]);
+            }
+          }
+          std::printf("\n");
+        }
+        return;
+      }
+      iterations *= 2;
+    }
+  }
+}  // namespace
+
+namespace bench {
+  std::vector<registration>& registry() {
+    static std::vector<registration> r;
+    return r;
+  }
+
+  std::size_t allocations() {
+    std::size_t n = 0;
+    for (auto const& c : allocation_counts) {
+      n += c.count.load(std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  void report_time(double seconds) { reported_time = seconds; }
+}  // namespace bench
+
+namespace {
+  void count_allocation() {
+    auto& c = local_allocation_counter().count;
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+}  // namespace
+
+void* operator new(std::size_t n) {
+  count_allocation();
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  TOBY_THROW(std::bad_alloc());
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Over-aligned types, such as the batches of bench_batch, are allocated with
+// these instead.
+void* operator new(std::size_t n, std::align_val_t a) {
+  count_allocation();
+  auto align = std::size_t(a);
+#if defined(_MSC_VER)
+  if (void* p = _aligned_malloc(n ? n : 1, align)) return p;
+#else
+  // aligned_alloc requires the size to be a multiple of the alignment.
+  auto size = (n + align - 1) / align * align;
+  if (void* p = std::aligned_alloc(align, size ? size : align)) return p;
+#endif
+  TOBY_THROW(std::bad_alloc());
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+#if defined(_MSC_VER)
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept {
+  operator delete(p, a);
+}
+
+// Usage: bench_coroutine_monad [--perf] [filter [min_seconds]]
+// Runs the benchmarks whose names contain `filter`. With --perf, also reports
+// hardware counters per operation, where they are available.
+int main(int argc, char** argv) {
+  bool perf = argc > 1 && std::strcmp(argv[1], "--perf") == 0;
+  if (perf) {
+    --argc;
+    ++argv;
+  }
+  char const* filter = argc > 1 ? argv[1] : "";
+  double min_seconds = argc > 2 ? std::atof(argv[2]) : 0.2;
+
+  std::unique_ptr<bench::perf::counters> counters;
+  if (perf) {
+    counters = std::make_unique<bench::perf::counters>();
+    if (!counters->any_available()) {
+      std::fprintf(stderr,
+                   "Hardware counters are unavailable (%s); reporting times "
+                   "only\n",
+                   counters->error().c_str());
+      counters.reset();
+    } else if (!counters->error().empty()) {
+      std::fprintf(stderr, "Some hardware counters are unavailable (%s)\n",
+                   counters->error().c_str());
+    }
+  }
+
+  for (auto const& r : bench::registry()) {
+    if (std::strstr(r.name, filter)) run_one(r, min_seconds, counters.get());
+  }
+
+#if defined(TOBY_FRAME_CENSUS)
+  std::cout << "\nCoroutine frames:\n";
+  toby::frame_census::print(std::cout);
+#endif
+}
@@ -0,0 +1,45 @@
+#include "maybe.h"
+
+#include "bench.h"
+
+#include <array>
+
+namespace {
+  struct config {
+    int limit;
+    std::array<int, 256> payload;
+  };
+
+  config const stored{42, {}};
+
+  config const* find_config(std::size_t i) {
+    return i % 1024 ? &stored : nullptr;
+  }
+
+  std::optional<config> find_config_copy(std::size_t i) {
+    if (auto p = find_config(i)) return *p;
+    return std::nullopt;
+  }
+
+  std::optional<int> limit_via_pointer(std::size_t i) {
+    auto& c = co_await find_config(i);
+    co_return c.limit;
+  }
+
+  std::optional<int> limit_via_optional(std::size_t i) {
+    auto c = co_await find_config_copy(i);
+    co_return c.limit;
+  }
+}  // namespace
+
+BENCHMARK("maybe/co_await pointer to large value") {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(limit_via_pointer(i));
+  }
+}
+
+BENCHMARK("maybe/co_await optional copy of large value") {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(limit_via_optional(i));
+  }
+}
@@ -0,0 +1,152 @@
+#ifndef BENCH_PERF_H
+#define BENCH_PERF_H
+
+// Hardware performance counters for the benchmark harness, read through
+// perf_event_open on Linux. Each counter is opened on its own, so that those
+// the CPU or the kernel doesn't support, or that the process isn't allowed to
+// use, are reported as unavailable while the rest are still read. Elsewhere no
+// counters are available.
+//
+// The counters are inherited by the threads that the process starts after
+// opening them, so a benchmark that runs on several threads is counted on all
+// of them. The counts of threads that have exited stay in the totals, so each
+// measurement is the difference between readings at its start and stop.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace bench::perf {
+  enum counter : std::size_t {
+    cycles,
+    instructions,
+    branch_misses,
+    l1d_misses,
+    llc_misses,
+    counter_count,
+  };
+
+  inline char const* const names[counter_count] = {
+      "cycles", "instrs", "br-miss", "L1d-miss", "LLC-miss"};
+
+  // The counts over one measurement; a count is negative if its counter is
+  // unavailable.
+  using reading = std::array<double, counter_count>;
+
+  class counters {
+   public:
+    counters() {
+      fds_.fill(-1);
+#if defined(__linux__)
+      auto cache = [](std::uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      };
+      open(cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      open(instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+      open(branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+      open(l1d_misses, PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D));
+      open(llc_misses, PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL));
+#else
+      error_ = "hardware counters are only supported on Linux";
+#endif
+    }
+
+    counters(counters const&) = delete;
+    counters& operator=(counters const&) = delete;
+
+    ~counters() {
+#if defined(__linux__)
+      for (int fd : fds_) {
+        if (fd >= 0) close(fd);
+      }
+#endif
+    }
+
+    bool any_available() const {
+      for (int fd : fds_) {
+        if (fd >= 0) return true;
+      }
+      return false;
+    }
+
+    // Why the first counter that couldn't be opened wasn't, if any wasn't.
+    std::string const& error() const { return error_; }
+
+    void start() {
+#if defined(__linux__)
+      for (std::size_t i = 0; i < counter_count; ++i) {
+        if (fds_[i] < 0) continue;
+        // Resetting doesn't clear what exited threads have counted.
+        if (!read(i, start_[i])) start_[i] = {};
+        ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+    }
+
+    reading stop() {
+      reading r;
+      r.fill(-1);
+#if defined(__linux__)
+      for (int fd : fds_) {
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+      for (std::size_t i = 0; i < counter_count; ++i) {
+        value v;
+        if (fds_[i] < 0 || !read(i, v)) continue;
+        for (std::size_t j = 0; j < v.size(); ++j) v[j] -= start_[i][j];
+        if (v[2] == 0) continue;
+        r[i] = double(v[0]) * double(v[1]) / double(v[2]);
+      }
+#endif
+      return r;
+    }
+
+   private:
+#if defined(__linux__)
+    void open(counter c, std::uint32_t type, std::uint64_t config) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof attr);
+      attr.size = sizeof attr;
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.inherit = 1;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fd < 0 && error_.empty()) {
+        error_ = std::string(names[c]) + ": " + std::strerror(errno);
+      }
+      fds_[c] = fd;
+    }
+
+    // The value of a counter, and the times for which it was enabled and
+    // running, so that it can be scaled if the kernel multiplexed it.
+    using value = std::array<std::uint64_t, 3>;
+
+    bool read(std::size_t i, value& v) const {
+      return ::read(fds_[i], v.data(), sizeof v) == sizeof v;
+    }
+
+    std::array<value, counter_count> start_{};
+#endif
+
+    std::array<int, counter_count> fds_;
+    std::string error_;
+  };
+}  // namespace bench::perf
+
+#endif  // BENCH_PERF_H
@@ -0,0 +1,79 @@
+#include "persistent.h"
+
+#include "bench.h"
+
+#include <map>
+
+namespace {
+  constexpr int entries = 100000;
+
+  auto const increment = [](int const* v) { return v ? *v + 1 : 1; };
+
+  std::map<int, int> make_std_map() {
+    std::map<int, int> m;
+    for (int i = 0; i < entries; ++i) m[i] = i;
+    return m;
+  }
+
+  toby::persistent::map<int, int> make_persistent_map() {
+    auto t = toby::persistent::map<int, int>().make_transient();
+    for (int i = 0; i < entries; ++i) t.set(i, i);
+    return std::move(t).persistent();
+  }
+
+  // One step of a State computation that keeps the previous state as a
+  // snapshot before updating one entry.
+  template <typename Map, typename Update>
+  void snapshot_and_update(std::size_t iterations, Map m, Update update) {
+    Map snapshot;
+    for (std::size_t i = 0; i < iterations; ++i) {
+      auto r = (toby::state::get >>= [&](Map s) {
+                 snapshot = std::move(s);
+                 return update(int(i % entries));
+               }).run(std::move(m));
+      m = std::move(r.state);
+    }
+    bench::keep(snapshot);
+    bench::keep(m);
+  }
+}  // namespace
+
+BENCHMARK("persistent/snapshot and update a 100k entry std::map state") {
+  snapshot_and_update(iterations, make_std_map(), [](int key) {
+    return toby::state::modify([=](std::map<int, int>&& m) {
+      ++m[key];
+      return std::move(m);
+    });
+  });
+}
+
+BENCHMARK("persistent/snapshot and update a 100k entry persistent map state") {
+  snapshot_and_update(iterations, make_persistent_map(), [](int key) {
+    return toby::state::update_at(key, increment);
+  });
+}
+
+BENCHMARK("persistent/update a 100k entry persistent map state in place") {
+  auto m = make_persistent_map();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    m = toby::state::update_at(int(i % entries), increment)
+            .run(std::move(m))
+            .state;
+  }
+  bench::keep(m);
+}
+
+BENCHMARK_OPS("persistent/build a 100k entry persistent map with a transient",
+              entries) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(make_persistent_map());
+  }
+}
+
+BENCHMARK_OPS("persistent/build a 100k entry persistent map by value", entries) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    toby::persistent::map<int, int> m;
+    for (int j = 0; j < entries; ++j) m = m.set(j, j);
+    bench::keep(m);
+  }
+}
@@ -0,0 +1,148 @@
+#include "expected.h"
+#include "result.h"
+
+#include "bench.h"
+
+using std::experimental::expected;
+using std::experimental::make_unexpected;
+using toby::fail;
+using toby::result;
+
+// The steps below are kept out of line so that what is measured is the cost of
+// returning each kind of value from a call, rather than that of code into which
+// the optimizer has dissolved it.
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  BENCH_NOINLINE result<long, error> step_result(long x) {
+    if (x < 0) return fail(error{int(x)});
+    return x + 1;
+  }
+
+  BENCH_NOINLINE expected<long, error> step_expected(long x) {
+    if (x < 0) return make_unexpected(error{int(x)});
+    return x + 1;
+  }
+
+  result<long, error> chain_result(long x) {
+    auto a = co_await step_result(x);
+    auto b = co_await step_result(a);
+    auto c = co_await step_result(b);
+    co_return co_await step_result(c);
+  }
+
+  expected<long, error> chain_expected(long x) {
+    auto a = co_await step_expected(x);
+    auto b = co_await step_expected(a);
+    auto c = co_await step_expected(b);
+    co_return co_await step_expected(c);
+  }
+}  // namespace
+
+BENCHMARK_OPS("result/return from an out of line call", 4) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto a = step_result(long(i));
+    auto b = step_result(*a);
+    auto c = step_result(*b);
+    bench::keep(step_result(*c));
+  }
+}
+
+BENCHMARK_OPS("expected/return from an out of line call", 4) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto a = step_expected(long(i));
+    auto b = step_expected(*a);
+    auto c = step_expected(*b);
+    bench::keep(step_expected(*c));
+  }
+}
+
+BENCHMARK_OPS("result/co_await chain of out of line calls", 4) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(chain_result(long(i)));
+  }
+}
+
+BENCHMARK_OPS("expected/co_await chain of out of line calls", 4) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(chain_expected(long(i)));
+  }
+}
+
+namespace {
+  // A chain of ten steps, each of which fails for inputs that are a multiple of
+  // `every`, as in code that validates and transforms a value in stages.
+  result<long, error> validate(long x, long every) {
+    if (x % every == 0) return fail(error{int(x)});
+    return x;
+  }
+
+  result<long, error> chain_of_ten(long x, long every) {
+    auto a = co_await validate(x, every);
+    auto b = co_await validate(a + 1, every);
+    auto c = co_await validate(b * 3, every);
+    auto d = co_await validate(c - 2, every);
+    auto e = co_await validate(d ^ 5, every);
+    auto f = co_await validate(e + 7, every);
+    auto g = co_await validate(f * 5, every);
+    auto h = co_await validate(g - 11, every);
+    auto i = co_await validate(h ^ 13, every);
+    co_return co_await validate(i + 17, every);
+  }
+
+  void run_chain_of_ten(long every, std::size_t iterations) {
+    bench::keep(every);
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(chain_of_ten(long(i), every));
+    }
+  }
+}  // namespace
+
+// Building with TOBY_NO_BRANCH_HINTS defined gives the same chains without the
+// error path being kept out of line, for comparison.
+BENCHMARK_OPS("result/10-step co_await chain, rarely failing", 10) {
+  run_chain_of_ten(1 << 20, iterations);
+}
+
+BENCHMARK_OPS("result/10-step co_await chain, often failing", 10) {
+  run_chain_of_ten(7, iterations);
+}
+
+namespace {
+  // The same chain in a coroutine that converts exceptions into its error
+  // value, rather than terminating, which is the default.
+  result<long, std::exception_ptr> validate_or_throw(long x, long every) {
+    if (x % every == 0) return fail(std::make_exception_ptr(x));
+    return x;
+  }
+
+  result<long, std::exception_ptr> converting_chain_of_ten(long x,
+                                                           long every) {
+    auto a = co_await validate_or_throw(x, every);
+    auto b = co_await validate_or_throw(a + 1, every);
+    auto c = co_await validate_or_throw(b * 3, every);
+    auto d = co_await validate_or_throw(c - 2, every);
+    auto e = co_await validate_or_throw(d ^ 5, every);
+    auto f = co_await validate_or_throw(e + 7, every);
+    auto g = co_await validate_or_throw(f * 5, every);
+    auto h = co_await validate_or_throw(g - 11, every);
+    auto i = co_await validate_or_throw(h ^ 13, every);
+    co_return co_await validate_or_throw(i + 17, every);
+  }
+}  // namespace
+
+BENCHMARK_OPS("result/10-step co_await chain, converting exceptions", 10) {
+  long every = 1 << 20;
+  bench::keep(every);
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(converting_chain_of_ten(long(i), every));
+  }
+}
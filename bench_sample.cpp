@@ -0,0 +1,56 @@
+#include "sample.h"
+
+#include "bench.h"
+
+#include <functional>
+#include <thread>
+
+namespace {
+  auto in_unit_circle() -> toby::sample::sample<bool> {
+    auto x = co_await toby::sample::uniform;
+    auto y = co_await toby::sample::uniform;
+    co_return x * x + y * y <= 1.0;
+  }
+
+  auto const in_unit_circle_raw = toby::sample::uniform >>= [](double x) {
+    return toby::state::transform(
+        toby::sample::uniform, [=](double y) { return x * x + y * y <= 1.0; });
+  };
+
+  constexpr std::size_t samples = 1 << 16;
+
+  auto count_hits = [](std::size_t n, bool hit) { return n + hit; };
+
+  template <typename M>
+  void estimate_pi(M const& m, std::size_t iterations, unsigned threads) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(toby::sample::run_parallel(m, samples, i, std::size_t(0),
+                                             count_hits, std::plus<>{},
+                                             threads));
+    }
+  }
+
+  unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+}  // namespace
+
+// The single-threaded figures are the cost per sample on one core; comparing
+// them with the all-threads figures multiplied by the number of cores shows how
+// well run_parallel scales.
+
+BENCHMARK_OPS("sample/pi estimate, RawState, 1 thread (per sample)", samples) {
+  estimate_pi(in_unit_circle_raw, iterations, 1);
+}
+
+BENCHMARK_OPS("sample/pi estimate, RawState, all threads (per sample)",
+              samples) {
+  estimate_pi(in_unit_circle_raw, iterations, cores);
+}
+
+BENCHMARK_OPS("sample/pi estimate, coroutine, 1 thread (per sample)", samples) {
+  estimate_pi(in_unit_circle, iterations, 1);
+}
+
+BENCHMARK_OPS("sample/pi estimate, coroutine, all threads (per sample)",
+              samples) {
+  estimate_pi(in_unit_circle, iterations, cores);
+}
@@ -0,0 +1,279 @@
+#include "compiler.h"
+#include "expected.h"
+#include "function_tc.h"
+#include "maybe.h"
+#include "monad_promise.h"
+#include "state.h"
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using std::experimental::expected;
+using std::experimental::make_unexpected;
+
+// Each benchmark here runs the same pipeline on several threads at once, each
+// thread with its own data, so that nothing is shared but the allocator and
+// whatever the library itself shares. The threads are started before the timing
+// and released together, and the time reported per operation is from the first
+// of them starting its pipeline to the last finishing, divided by the
+// operations of all threads together, so with perfect scaling it halves each
+// time the number of threads doubles. A pipeline whose figure stops falling
+// with more threads is contending for something, and comparing it with the
+// allocator on its own shows whether that is the allocation of its coroutine
+// frames.
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  TOBY_NOINLINE expected<long, error> step_expected(long x) {
+    if (x < 0) return make_unexpected(error{int(x)});
+    return x + 1;
+  }
+
+  expected<long, error> chain_expected(long x) {
+    auto a = co_await step_expected(x);
+    auto b = co_await step_expected(a);
+    auto c = co_await step_expected(b);
+    co_return co_await step_expected(c);
+  }
+
+  expected<long, error> chain_expected_manual(long x) {
+    auto a = step_expected(x);
+    if (!a) return make_unexpected(a.error());
+    auto b = step_expected(*a);
+    if (!b) return make_unexpected(b.error());
+    auto c = step_expected(*b);
+    if (!c) return make_unexpected(c.error());
+    return step_expected(*c);
+  }
+
+  TOBY_NOINLINE std::optional<long> step_optional(long x) {
+    if (x < 0) return std::nullopt;
+    return x + 1;
+  }
+
+  std::optional<long> chain_optional(long x) {
+    auto a = co_await step_optional(x);
+    auto b = co_await step_optional(a);
+    auto c = co_await step_optional(b);
+    co_return co_await step_optional(c);
+  }
+
+  struct counter_state {
+    long value;
+  };
+
+  using CounterState = toby::state::StateTC<OneShotFunctionTC, counter_state>;
+
+  auto next_state() -> CounterState::t<long> {
+    auto s = co_await toby::state::get;
+    co_await toby::state::put(counter_state{s.value + 1});
+    co_return s.value;
+  }
+
+  // The size of a typical coroutine frame, for the allocator on its own.
+  struct frame {
+    char bytes[512];
+  };
+
+  void expected_coroutine(std::size_t iterations) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(chain_expected(long(i)));
+    }
+  }
+
+  void expected_manual(std::size_t iterations) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(chain_expected_manual(long(i)));
+    }
+  }
+
+  void optional_coroutine(std::size_t iterations) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(chain_optional(long(i)));
+    }
+  }
+
+  void state_coroutine(std::size_t iterations) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+      bench::keep(next_state().run(counter_state{long(i)}));
+    }
+  }
+
+  void allocator(std::size_t iterations) {
+    for (std::size_t i = 0; i < iterations; ++i) {
+      auto p = new frame;
+      bench::keep(p);
+      delete p;
+    }
+  }
+
+  // Threads that run a pipeline side by side, each for the same number of
+  // iterations. They are started once, and wait between runs, so that
+  // starting and joining them isn't timed.
+  class pool {
+   public:
+    explicit pool(unsigned threads) : times_(threads) {
+      for (unsigned t = 0; t < threads; ++t) {
+        threads_.emplace_back([this, t] { work(t); });
+      }
+    }
+
+    pool(pool const&) = delete;
+    pool& operator=(pool const&) = delete;
+
+    ~pool() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      wake_.notify_all();
+      for (auto& t : threads_) t.join();
+    }
+
+    std::size_t size() const { return threads_.size(); }
+
+    // Runs the pipeline on every thread and returns the time, in seconds,
+    // from the earliest start to the latest finish. The threads start
+    // together, as each waits at a barrier until all have woken.
+    double run(bench::body pipeline, std::size_t iterations) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pipeline_ = pipeline;
+        iterations_ = iterations;
+        ready_.store(0);
+        finished_ = 0;
+        ++generation_;
+      }
+      wake_.notify_all();
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [&] { return finished_ == threads_.size(); });
+      auto start = times_[0].first;
+      auto end = times_[0].second;
+      for (auto const& [s, e] : times_) {
+        start = std::min(start, s);
+        end = std::max(end, e);
+      }
+      return std::chrono::duration<double>(end - start).count();
+    }
+
+   private:
+    using clock = std::chrono::steady_clock;
+
+    void work(unsigned t) {
+      std::uint64_t seen = 0;
+      for (;;) {
+        bench::body pipeline;
+        std::size_t iterations;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+          if (stopping_) return;
+          seen = generation_;
+          pipeline = pipeline_;
+          iterations = iterations_;
+        }
+        auto threads = unsigned(threads_.size());
+        ready_.fetch_add(1);
+        while (ready_.load() < threads) std::this_thread::yield();
+        auto start = clock::now();
+        pipeline(iterations);
+        auto end = clock::now();
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          times_[t] = {start, end};
+          ++finished_;
+        }
+        done_.notify_one();
+      }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bench::body pipeline_ = nullptr;
+    std::size_t iterations_ = 0;
+    std::uint64_t generation_ = 0;
+    std::atomic<unsigned> ready_{0};
+    std::size_t finished_ = 0;
+    bool stopping_ = false;
+    std::vector<std::pair<clock::time_point, clock::time_point>> times_;
+    std::vector<std::thread> threads_;
+  };
+
+  // The threads of the benchmark being run. A benchmark's first run starts
+  // them, as the benchmark before it ran on a different number of threads,
+  // and its later runs reuse them.
+  pool& threads(unsigned n) {
+    static std::unique_ptr<pool> p;
+    if (!p || p->size() != n) {
+      p.reset();
+      p = std::make_unique<pool>(n);
+    }
+    return *p;
+  }
+
+  unsigned const cores = std::max(1u, std::thread::hardware_concurrency());
+
+  // The names of the scaling benchmarks, which the registry refers to, in a
+  // container that doesn't move them.
+  std::deque<std::string>& names() {
+    static std::deque<std::string> n;
+    return n;
+  }
+
+  // Registers a pipeline on 1, 2, 4 and so on up to 64 threads, as many of
+  // those as the machine has cores for.
+  template <bench::body Pipeline>
+  struct scaling {
+    explicit scaling(char const* name) {
+      add<1>(name);
+      add<2>(name);
+      add<4>(name);
+      add<8>(name);
+      add<16>(name);
+      add<32>(name);
+      add<64>(name);
+    }
+
+    template <unsigned Threads>
+    static void run(std::size_t iterations) {
+      bench::report_time(threads(Threads).run(Pipeline, iterations));
+    }
+
+    template <unsigned Threads>
+    static void add(char const* name) {
+      if (Threads > cores && Threads > 1) return;
+      names().push_back("scaling/" + std::string(name) + ", " +
+                        std::to_string(Threads) +
+                        (Threads == 1 ? " thread" : " threads"));
+      bench::registrar(names().back().c_str(), &run<Threads>, Threads);
+    }
+  };
+
+  scaling<expected_coroutine> const expected_coroutine_scaling{
+      "expected 4-step co_await chain"};
+  scaling<expected_manual> const expected_manual_scaling{
+      "expected 4-step manual chain"};
+  scaling<optional_coroutine> const optional_coroutine_scaling{
+      "optional 4-step co_await chain"};
+  scaling<state_coroutine> const state_coroutine_scaling{
+      "State co_await get and put"};
+  scaling<allocator> const allocator_scaling{
+      "allocator alone, 512-byte new and delete"};
+}  // namespace
@@ -0,0 +1,95 @@
+#include "state.h"
+
+#include "function_tc.h"
+
+#include "bench.h"
+
+#include <array>
+
+namespace {
+  struct random_state {
+    int next_value;
+  };
+
+  using MyState = toby::state::StateTC<StdFunctionTC, random_state>;
+  using MyStateOneShot = toby::state::StateTC<OneShotFunctionTC, random_state>;
+
+  auto next_random_erased_co() -> MyStateOneShot::t<int> {
+    auto rs = co_await MyState::get;
+    co_await MyState::put(random_state{rs.next_value + 1});
+    co_return rs.next_value;
+  }
+
+  auto next_random_raw_co() -> MyStateOneShot::t<int> {
+    auto rs = co_await toby::state::get;
+    co_await toby::state::put(random_state{rs.next_value + 1});
+    co_return rs.next_value;
+  }
+}  // namespace
+
+BENCHMARK_OPS("state/co_await type-erased get and put (per co_await)", 2) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(next_random_erased_co().run(random_state{int(i)}));
+  }
+}
+
+BENCHMARK_OPS("state/co_await RawState get and put (per co_await)", 2) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    bench::keep(next_random_raw_co().run(random_state{int(i)}));
+  }
+}
+
+namespace {
+  struct large_state {
+    int counter;
+    std::array<int, 1024> payload;
+  };
+
+  using LargeState = toby::state::StateTC<StdFunctionTC, large_state>;
+
+  auto const increment_get_put = LargeState::get >>= [](large_state s) {
+    ++s.counter;
+    return LargeState::put(std::move(s));
+  };
+
+  auto const increment_modify = LargeState::modify([](large_state&& s) {
+    ++s.counter;
+    return std::move(s);
+  });
+
+  auto const read_gets = LargeState::gets(&large_state::counter);
+}  // namespace
+
+BENCHMARK("state/increment a member of a large state with get and put") {
+  large_state s{};
+  for (std::size_t i = 0; i < iterations; ++i) {
+    s = increment_get_put.run(std::move(s)).state;
+  }
+  bench::keep(s);
+}
+
+BENCHMARK("state/increment a member of a large state with modify") {
+  large_state s{};
+  for (std::size_t i = 0; i < iterations; ++i) {
+    s = increment_modify.run(std::move(s)).state;
+  }
+  bench::keep(s);
+}
+
+BENCHMARK("state/read a member of a large state with get") {
+  large_state s{};
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto r = LargeState::get.run(std::move(s));
+    bench::keep(r.data.counter);
+    s = std::move(r.state);
+  }
+}
+
+BENCHMARK("state/read a member of a large state with gets") {
+  large_state s{};
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto r = read_gets.run(std::move(s));
+    bench::keep(r.data);
+    s = std::move(r.state);
+  }
+}
@@ -0,0 +1,73 @@
+#include "state_in_place.h"
+
+#include "bench.h"
+
+#include <array>
+#include <memory>
+
+namespace {
+  // A stand-in for a simulation state: a large aggregate of which each step
+  // touches only a small part.
+  struct simulation {
+    long step;
+    std::array<double, 32 * 1024> cells;
+  };
+
+  namespace ip = toby::state::in_place;
+
+  auto const by_value_step = toby::state::get >>= [](simulation s) {
+    ++s.step;
+    s.cells[s.step % s.cells.size()] += 1.0;
+    return toby::state::put(std::move(s));
+  };
+
+  auto const in_place_step = ip::get >>= [](simulation s) {
+    ++s.step;
+    s.cells[s.step % s.cells.size()] += 1.0;
+    return ip::put(std::move(s));
+  };
+
+  auto const by_value_modify_step =
+      toby::state::modify([](simulation&& s) -> simulation&& {
+        ++s.step;
+        s.cells[s.step % s.cells.size()] += 1.0;
+        return std::move(s);
+      });
+
+  auto const in_place_modify_step = ip::modify([](simulation& s) {
+    ++s.step;
+    s.cells[s.step % s.cells.size()] += 1.0;
+  });
+}  // namespace
+
+BENCHMARK("state in place/by-value get and put on a 256KiB state") {
+  auto s = std::make_unique<simulation>();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    *s = by_value_step.run(std::move(*s)).state;
+  }
+  bench::keep(s->step);
+}
+
+BENCHMARK("state in place/in-place get and put on a 256KiB state") {
+  auto s = std::make_unique<simulation>();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    in_place_step.run(*s);
+  }
+  bench::keep(s->step);
+}
+
+BENCHMARK("state in place/by-value modify on a 256KiB state") {
+  auto s = std::make_unique<simulation>();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    *s = by_value_modify_step.run(std::move(*s)).state;
+  }
+  bench::keep(s->step);
+}
+
+BENCHMARK("state in place/in-place modify on a 256KiB state") {
+  auto s = std::make_unique<simulation>();
+  for (std::size_t i = 0; i < iterations; ++i) {
+    in_place_modify_step.run(*s);
+  }
+  bench::keep(s->step);
+}
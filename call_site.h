@@ -0,0 +1,44 @@
+#ifndef CALL_SITE_H
+#define CALL_SITE_H
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+namespace toby {
+  // The location of a co_await: its file and line, and the function it is in.
+  // As a default argument, current() is evaluated where the function is
+  // called, so it captures the co_await expression that the compiler calls
+  // await_transform for. std::source_location does the same in C++20.
+  struct call_site {
+    char const* file = nullptr;
+    unsigned line = 0;
+    char const* function = nullptr;
+
+    static constexpr call_site current(
+        char const* file = __builtin_FILE(),
+        unsigned line = __builtin_LINE(),
+        char const* function = __builtin_FUNCTION()) {
+      return {file, line, function};
+    }
+
+    // The function is implied by the file and line. Files are compared by
+    // name, as the same name need not be at the same address in each
+    // translation unit; the pointers are compared first as they usually are.
+    friend bool operator==(call_site const& a, call_site const& b) {
+      if (a.line != b.line) return false;
+      if (a.file == b.file) return true;
+      return a.file && b.file && std::strcmp(a.file, b.file) == 0;
+    }
+  };
+
+  struct call_site_hash {
+    std::size_t operator()(call_site const& s) const {
+      std::string_view file = s.file ? s.file : "";
+      return std::hash<std::string_view>()(file) * 31 + s.line;
+    }
+  };
+}  // namespace toby
+
+#endif  // CALL_SITE_H
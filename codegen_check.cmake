@@ -0,0 +1,95 @@
+# Compares the machine code of the three variants of codegen_expected.cpp,
+# given as object files, by disassembling them with objdump. Run as
+#
+#   cmake -DOBJDUMP=objdump -DMANUAL=manual.o -DBIND=bind.o
+#         -DCOROUTINE=coroutine.o -DMAX_RATIO=25 [-DCOROUTINE_UNWINDS=OFF]
+#         -P codegen_check.cmake
+#
+# For each object it counts the instructions, including those of the functions
+# that the variant instantiates, and the calls to allocation functions, to
+# functions that throw, and to those that unwind: the landing pads that run
+# destructors and handlers as an exception passes. Calls are found through the
+# relocations of an ELF object. It fails if the manual or bind variant
+# allocates or unwinds, if the bind variant has more than BIND_RATIO times as
+# many instructions as the manual one, or if the coroutine variant has more
+# than MAX_RATIO times as many. With COROUTINE_UNWINDS off, as for objects
+# built without exceptions, it also fails if the coroutine variant unwinds.
+
+if(NOT DEFINED BIND_RATIO)
+  set(BIND_RATIO 1.5)
+endif()
+if(NOT DEFINED COROUTINE_UNWINDS)
+  set(COROUTINE_UNWINDS ON)
+endif()
+
+function(inspect variant object)
+  execute_process(
+    COMMAND ${OBJDUMP} -d -r --no-show-raw-insn ${object}
+    OUTPUT_VARIABLE listing
+    RESULT_VARIABLE status)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${OBJDUMP} failed on ${object}")
+  endif()
+  # Instructions are indented with spaces and relocations with tabs.
+  string(REGEX MATCHALL "\n +[0-9a-f]+:\t" instructions "${listing}")
+  string(REGEX MATCHALL "R_[A-Z0-9_]+\t(_Znw|_Zna|malloc|calloc)"
+      allocations "${listing}")
+  string(REGEX MATCHALL "R_[A-Z0-9_]+\t__cxa_throw" throwing "${listing}")
+  string(REGEX MATCHALL
+      "R_[A-Z0-9_]+\t(_Unwind_Resume|__cxa_(rethrow|begin_catch))"
+      unwinding "${listing}")
+  list(LENGTH instructions i)
+  list(LENGTH allocations a)
+  list(LENGTH throwing t)
+  list(LENGTH unwinding u)
+  message(STATUS
+      "${variant}: ${i} instructions, ${a} allocation calls, "
+      "${t} throwing calls, ${u} unwinding calls")
+  set(${variant}_instructions ${i} PARENT_SCOPE)
+  set(${variant}_allocations ${a} PARENT_SCOPE)
+  set(${variant}_unwinding ${u} PARENT_SCOPE)
+endfunction()
+
+inspect(manual ${MANUAL})
+inspect(bind ${BIND})
+inspect(coroutine ${COROUTINE})
+
+if(manual_instructions EQUAL 0)
+  message(FATAL_ERROR "No instructions found in ${MANUAL}")
+endif()
+foreach(variant manual bind)
+  if(${variant}_allocations GREATER 0)
+    message(SEND_ERROR "The ${variant} variant allocates")
+  endif()
+endforeach()
+set(unwinding_checked manual bind)
+if(NOT COROUTINE_UNWINDS)
+  list(APPEND unwinding_checked coroutine)
+endif()
+foreach(variant ${unwinding_checked})
+  if(${variant}_unwinding GREATER 0)
+    message(SEND_ERROR "The ${variant} variant has unwinding code")
+  endif()
+endforeach()
+
+# math(EXPR) only does integers, so the ratios are compared in hundredths.
+foreach(check bind:BIND_RATIO coroutine:MAX_RATIO)
+  string(REPLACE ":" ";" check ${check})
+  list(GET check 0 variant)
+  list(GET check 1 ratio)
+  string(REGEX MATCH "^([0-9]+)(\\.([0-9]?[0-9]?))?$" valid "${${ratio}}")
+  if(NOT valid)
+    message(FATAL_ERROR "${ratio} must be a number with up to two decimals")
+  endif()
+  set(fraction "${CMAKE_MATCH_3}00")
+  string(SUBSTRING ${fraction} 0 2 fraction)
+  math(EXPR limit "${CMAKE_MATCH_1} * 100 + 1${fraction} - 100")
+  math(EXPR limit "${limit} * ${manual_instructions}")
+  math(EXPR actual "${${variant}_instructions} * 100")
+  if(actual GREATER limit)
+    message(SEND_ERROR
+        "The ${variant} variant has ${${variant}_instructions} instructions, "
+        "more than ${${ratio}} times the ${manual_instructions} of the manual "
+        "variant")
+  endif()
+endforeach()
@@ -0,0 +1,42 @@
+// The three ways of composing calls to functions returning expected from
+// test_expected.cpp, compiled one per object file, with CODEGEN_MANUAL,
+// CODEGEN_BIND or CODEGEN_COROUTINE defined, so that codegen_check.cmake can
+// compare the optimized machine code of each. The functions being composed are
+// only declared, so that the optimizer can't fold the compositions away.
+
+#include "expected.h"
+
+using std::experimental::expected;
+using std::experimental::make_unexpected;
+
+struct error {
+  int code;
+};
+
+expected<int, error> f1() noexcept;
+expected<double, error> f2(int x) noexcept;
+expected<int, error> f3(int x, double y) noexcept;
+
+#if defined(CODEGEN_MANUAL)
+expected<int, error> codegen_variant() {
+  auto x = f1();
+  if (!x) return make_unexpected(x.error());
+  auto y = f2(*x);
+  if (!y) return make_unexpected(y.error());
+  return f3(*x, *y);
+}
+#elif defined(CODEGEN_BIND)
+expected<int, error> codegen_variant() {
+  return f1().bind([](int x) {
+    return f2(x).bind([x](double y) { return f3(x, y); });
+  });
+}
+#elif defined(CODEGEN_COROUTINE)
+expected<int, error> codegen_variant() {
+  auto x = co_await f1();
+  auto y = co_await f2(x);
+  co_return co_await f3(x, y);
+}
+#else
+#error "Define one of CODEGEN_MANUAL, CODEGEN_BIND and CODEGEN_COROUTINE"
+#endif
@@ -0,0 +1,142 @@
+#!/bin/sh
+# Measures how long the compiler's front end takes, and how much memory it
+# uses, on translation units that compose N calls with co_await or with >>=,
+# for expected and for State, and on one that only includes the headers.
+#
+#   ./compile_time.sh [N...]
+#
+# N defaults to 1 10 50 100. CXX and CXXFLAGS select the compiler and its
+# flags, which default to those in CMakeLists.txt; REPEAT sets how many times
+# each unit is compiled, the fastest time being reported. Memory is reported
+# where GNU time is installed as /usr/bin/time.
+
+set -e
+
+CXX=${CXX:-clang++}
+CXXFLAGS=${CXXFLAGS:--std=c++17 -fcoroutines-ts -stdlib=libc++}
+REPEAT=${REPEAT:-3}
+ROOT=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+[ $# -gt 0 ] || set -- 1 10 50 100
+
+# The prologue of each kind of unit.
+prologue() {
+  case $1 in
+    include)
+      echo '#include "state.h"'
+      ;;
+    expected_*)
+      cat <<'EOF'
+#include "expected.h"
+
+using std::experimental::expected;
+
+expected<int, int> step(int x);
+EOF
+      ;;
+    state_*)
+      cat <<'EOF'
+#include "function_tc.h"
+#include "state.h"
+
+namespace ts = toby::state;
+using IntState = ts::StateTC<OneShotFunctionTC, int>;
+
+constexpr auto step(int x) {
+  return ts::modify([x](int s) { return s + x; }) >>= [](auto&&) {
+    return ts::gets([](int s) { return s; });
+  };
+}
+EOF
+      ;;
+  esac
+}
+
+# The body: a function composing n steps.
+body() {
+  kind=$1
+  n=$2
+  i=0
+  case $kind in
+    include)
+      ;;
+    expected_coroutine|state_coroutine)
+      if [ $kind = expected_coroutine ]; then
+        echo 'expected<int, int> chain(int v0) {'
+      else
+        echo 'IntState::t<int> chain(int v0) {'
+      fi
+      while [ $i -lt $n ]; do
+        echo "  auto v$((i + 1)) = co_await step(v$i);"
+        i=$((i + 1))
+      done
+      echo "  co_return v$n;"
+      echo '}'
+      ;;
+    expected_bind|state_bind)
+      if [ $kind = expected_bind ]; then
+        echo 'expected<int, int> chain(int v0) {'
+        # expected fuses chains of >>=, so each lambda converts the chain
+        # nested in it to the expected that bind requires.
+        arrow=' -> expected<int, int>'
+      else
+        echo 'IntState::t<int> chain(int v0) {'
+        arrow=
+      fi
+      printf '  return '
+      while [ $i -lt $((n - 1)) ]; do
+        printf 'step(v%d) >>= [=](int v%d)%s {\n    return ' $i $((i + 1)) \
+            "$arrow"
+        i=$((i + 1))
+      done
+      printf 'step(v%d)' $i
+      i=1
+      while [ $i -lt $n ]; do
+        printf '; }'
+        i=$((i + 1))
+      done
+      echo ';'
+      echo '}'
+      ;;
+  esac
+}
+
+# Prints the fastest of REPEAT compilations of a unit, in milliseconds, and
+# the peak memory of the last, in kilobytes.
+measure() {
+  best=
+  memory=-
+  r=0
+  while [ $r -lt $REPEAT ]; do
+    start=$(date +%s%N)
+    if [ -x /usr/bin/time ]; then
+      /usr/bin/time -f %M -o "$WORK/memory" $CXX $CXXFLAGS -I"$ROOT" \
+          -I"$ROOT/std-make/include" -fsyntax-only "$1"
+      memory=$(cat "$WORK/memory")
+    else
+      $CXX $CXXFLAGS -I"$ROOT" -I"$ROOT/std-make/include" -fsyntax-only "$1"
+    fi
+    end=$(date +%s%N)
+    ms=$(((end - start) / 1000000))
+    if [ -z "$best" ] || [ $ms -lt $best ]; then best=$ms; fi
+    r=$((r + 1))
+  done
+  echo "$best $memory"
+}
+
+printf '%-20s %6s %10s %12s\n' unit N ms KB
+for kind in include expected_coroutine expected_bind state_coroutine \
+    state_bind; do
+  for n in "$@"; do
+    unit="$WORK/${kind}_$n.cpp"
+    { prologue $kind; body $kind $n; } > "$unit"
+    result=$(measure "$unit")
+    if [ $kind = include ]; then
+      printf '%-20s %6s %10s %12s\n' $kind - ${result% *} ${result#* }
+      break
+    fi
+    printf '%-20s %6s %10s %12s\n' $kind $n ${result% *} ${result#* }
+  done
+done
@@ -0,0 +1,63 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <exception>
+
+// Hints to the compiler about which paths are hot and which are cold.
+//
+// The paths on which a monadic coroutine short-circuits, because an awaited
+// value holds an error or is null, are marked cold and kept out of line, so
+// that the code for the success path, which is what runs almost always, is
+// laid out contiguously. Defining TOBY_NO_BRANCH_HINTS turns the hints off,
+// which is useful for measuring what they are worth.
+
+#if defined(TOBY_NO_BRANCH_HINTS)
+#define TOBY_LIKELY(x) (x)
+#define TOBY_UNLIKELY(x) (x)
+#define TOBY_NOINLINE
+#define TOBY_COLD
+#elif defined(_MSC_VER)
+#define TOBY_LIKELY(x) (x)
+#define TOBY_UNLIKELY(x) (x)
+#define TOBY_NOINLINE __declspec(noinline)
+#define TOBY_COLD
+#else
+#define TOBY_LIKELY(x) __builtin_expect(!!(x), 1)
+#define TOBY_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define TOBY_NOINLINE __attribute__((noinline))
+#define TOBY_COLD __attribute__((cold))
+#endif
+
+// Marks a function that does nothing but forward to another, such as the
+// layers between >>= and the bind of a monad, or the conversion of a
+// coroutine's return object. Such functions are inlined even without
+// optimization, where in a debug build they would otherwise make up much of
+// the time spent in monadic code, and with GCC, debuggers step through them
+// into what they forward to. Defining TOBY_NO_FORCE_INLINE turns this off.
+//
+// MSVC doesn't inline anything under /Od, whatever the function is marked.
+// GCC only honours the attributes on functions declared inline, hence the
+// keyword, which is redundant on the templates and members it is used on.
+
+#if defined(TOBY_NO_FORCE_INLINE) || defined(_MSC_VER)
+#define TOBY_FORWARDER inline
+#elif defined(__clang__)
+#define TOBY_FORWARDER __attribute__((always_inline)) inline
+#else
+#define TOBY_FORWARDER __attribute__((always_inline, artificial)) inline
+#endif
+
+// Whether the program is built with exceptions. Building without them, with
+// -fno-exceptions, is the mode in which the compiler emits no unwinding code
+// for coroutine frames; see exception_traits.h. The headers then terminate
+// where they would otherwise throw.
+
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+#define TOBY_EXCEPTIONS 1
+#define TOBY_THROW(e) throw e
+#else
+#define TOBY_EXCEPTIONS 0
+#define TOBY_THROW(e) std::terminate()
+#endif
+
+#endif  // COMPILER_H
@@ -0,0 +1,41 @@
+#ifndef EXCEPTION_TRAITS_H
+#define EXCEPTION_TRAITS_H
+
+#include "compiler.h"
+
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+// What a coroutine returning M does with an exception that escapes its body,
+// which is chosen per monad by specializing exception_traits.
+enum class exception_policy {
+  // unhandled_exception is noexcept and calls std::terminate. A monadic
+  // coroutine may be resumed from inside the bind of whatever it awaited,
+  // possibly long after it was first called, so there is in general nobody to
+  // propagate the exception to. This is the default.
+  terminate,
+  // The specialization also provides
+  //
+  //   static M from_exception(std::exception_ptr e);
+  //
+  // and the coroutine returns the M that it builds from the exception, which
+  // is usually the monad's error value, as if it had done a co_return of it.
+  convert,
+};
+
+// Either policy still leaves the compiler to generate the unwinding code that
+// destroys a frame's locals as an exception passes. Building without
+// exceptions, with -fno-exceptions, is what removes it: then TOBY_EXCEPTIONS is
+// 0, no coroutine can see an exception, and both policies come to the same.
+template <typename M, typename = void>
+struct exception_traits {
+  static constexpr exception_policy policy = exception_policy::terminate;
+};
+
+template <typename M>
+struct converts_exceptions
+    : std::bool_constant<TOBY_EXCEPTIONS && exception_traits<M>::policy ==
+                                                exception_policy::convert> {};
+
+#endif  // EXCEPTION_TRAITS_H
@@ -0,0 +1,47 @@
+#ifndef EXPECTED_H
+#define EXPECTED_H
+
+// Make the expected of viboes' std-make usable as a monad in coroutines and in
+// chains of >>=. expected itself knows nothing about coroutines, so everything
+// that adapts it lives here, and every file that uses it includes this rather
+// than specializing the same templates again.
+
+#include "monad_promise.h"
+
+#include <experimental/expected.hpp>
+
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+namespace std::experimental {
+  // This makes expected<T, E> useable as a coroutine return type.
+  template <typename T, typename E, typename... Args>
+  struct coroutine_traits<expected<T, E>, Args...> {
+    using promise_type = monad_promise<expected<T, E>>;
+  };
+}  // namespace std::experimental
+
+// expected's bind passes its continuation a reference to its value when called
+// on an lvalue, so co_await on an lvalue expected can yield a reference.
+template <typename T, typename E>
+struct yields_reference<std::experimental::expected<T, E>> : std::true_type {};
+
+// Chains of >>= on expected are evaluated right-nested.
+template <typename T, typename E>
+struct fuses_binds<std::experimental::expected<T, E>> : std::true_type {};
+
+// A coroutine returning an expected whose error type is std::exception_ptr
+// returns any exception that escapes its body as the error, as one returning a
+// result does.
+template <typename T>
+struct exception_traits<std::experimental::expected<T, std::exception_ptr>> {
+  static constexpr exception_policy policy = exception_policy::convert;
+
+  static std::experimental::expected<T, std::exception_ptr> from_exception(
+      std::exception_ptr e) {
+    return std::experimental::make_unexpected(std::move(e));
+  }
+};
+
+#endif  // EXPECTED_H
@@ -0,0 +1,147 @@
+#ifndef FRAME_CENSUS_H
+#define FRAME_CENSUS_H
+
+#include "call_site.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(TOBY_FRAME_CENSUS)
+#include "thread_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#endif
+
+/*!
+= Frame census
+
+When TOBY_FRAME_CENSUS is defined, the operator new of monad_promise and
+maybe_promise records the size of every coroutine frame that they allocate,
+against the coroutine function whose frame it is. The size of a frame is fixed
+for each function, and includes its parameters, its locals that live across a
+co_await, and the awaitables of its co_awaits with their storage for the awaited
+values, so the functions with the largest frames are where to look for those.
+
+`report()` gives, for each coroutine function, the number of frames allocated,
+their size and the total bytes, summed over all threads, largest total first;
+`print()` writes it as a table. The benchmarks print it when built with the
+COROUTINE_MONAD_FRAME_CENSUS CMake option, so that frame sizes can be compared
+between builds.
+
+As with the other instrumentation, each thread counts into its own entries,
+taking a lock only the first time it sees a function. Without
+TOBY_FRAME_CENSUS, `record()` does nothing and `report()` and `print()` aren't
+declared. It must be defined, or not, consistently across a program.
+*/
+
+namespace toby::frame_census {
+#if defined(TOBY_FRAME_CENSUS)
+  inline constexpr bool enabled = true;
+#else
+  inline constexpr bool enabled = false;
+#endif
+
+  struct entry {
+    // The coroutine function, as seen by the call to operator new in it.
+    call_site function;
+    std::uint64_t frames = 0;
+    std::uint64_t frame_size = 0;
+    std::uint64_t bytes = 0;
+  };
+
+#if defined(TOBY_FRAME_CENSUS)
+  namespace detail {
+    struct live_entry {
+      std::atomic<std::uint64_t> frames{0};
+      std::atomic<std::uint64_t> frame_size{0};
+
+      void record(std::size_t size) {
+        frames.store(frames.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+        frame_size.store(size, std::memory_order_relaxed);
+      }
+    };
+
+    using entry_map = std::unordered_map<call_site, entry, call_site_hash>;
+
+    // The entries of one thread. Only the thread itself adds functions, which
+    // it does under the lock so that report can read the map.
+    struct thread_entries {
+      std::mutex mutex;
+      std::unordered_map<call_site, std::unique_ptr<live_entry>, call_site_hash>
+          functions;
+
+      live_entry& at(call_site const& function) {
+        auto it = functions.find(function);
+        if (it != functions.end()) return *it->second;
+        std::lock_guard<std::mutex> lock(mutex);
+        return *functions.emplace(function, std::make_unique<live_entry>())
+                    .first->second;
+      }
+
+      void add_to(entry_map& merged) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& [function, e] : functions) {
+          auto& m = merged[function];
+          m.function = function;
+          auto frames = e->frames.load(std::memory_order_relaxed);
+          auto size = e->frame_size.load(std::memory_order_relaxed);
+          m.frames += frames;
+          m.frame_size = size;
+          m.bytes += frames * size;
+        }
+      }
+
+      void retire(entry_map& retired) { add_to(retired); }
+    };
+
+    using registry = thread_registry<thread_entries, entry_map>;
+
+    inline thread_entries& local() {
+      return registry::local();
+    }
+  }  // namespace detail
+
+  // Records the allocation of a frame of the given size for a coroutine
+  // function on this thread.
+  inline void record(call_site const& function, std::size_t size) {
+    detail::local().at(function).record(size);
+  }
+
+  // The frames allocated for each coroutine function, summed over all threads,
+  // largest total first.
+  inline std::vector<entry> report() {
+    auto merged =
+        detail::registry::access([](auto const& retired, auto const& live) {
+          auto result = retired;
+          for (auto* t : live) t->add_to(result);
+          return result;
+        });
+    std::vector<entry> result;
+    result.reserve(merged.size());
+    for (auto const& [function, e] : merged) result.push_back(e);
+    std::sort(result.begin(), result.end(), [](auto const& a, auto const& b) {
+      return a.bytes > b.bytes;
+    });
+    return result;
+  }
+
+  inline void print(std::ostream& os) {
+    for (auto const& e : report()) {
+      os << e.function.function << " (" << e.function.file << ':'
+         << e.function.line << "): " << e.frames << " frames of "
+         << e.frame_size << " bytes, " << e.bytes << " bytes\n";
+    }
+  }
+#else
+  inline void record(call_site const&, std::size_t) {}
+#endif
+}  // namespace toby::frame_census
+
+#endif  // FRAME_CENSUS_H
@@ -0,0 +1,68 @@
+#ifndef FUNCTION_TC_H
+#define FUNCTION_TC_H
+
+// Type constructors for the function types that the type-erased State stores
+// its run function in.
+
+#include <experimental/make.hpp>
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// A function that may be invoked at most once. Unlike std::function, the
+// wrapped callable need not be copyable, which is what allows the continuations
+// created by monad_promise to be stored in it.
+template <typename R, typename... A>
+struct OneShotFunction {
+  struct IInvoker {
+    virtual ~IInvoker() = default;
+    virtual R invoke(A...) && = 0;
+  };
+
+  template <typename F>
+  struct Invoker : IInvoker {
+    F f;
+
+    template <typename G>
+    Invoker(G&& f) : f(std::forward<G>(f)) {}
+
+    R invoke(A... args) && override {
+      return std::move(f)(std::forward<A>(args)...);
+    }
+  };
+
+  std::shared_ptr<IInvoker> invoker;
+
+  template <typename F>
+  OneShotFunction(F&& f)
+      : invoker(std::make_shared<Invoker<std::remove_cvref_t<F>>>(
+            std::forward<F>(f))) {}
+
+  auto operator()(A... args) && {
+    return std::move(*invoker).invoke(std::forward<A>(args)...);
+  }
+};
+
+struct OneShotFunctionTC {
+  template <typename R, typename... A>
+  using invoke = OneShotFunction<R, A...>;
+};
+
+struct StdFunctionTC {
+  template <typename R, typename... A>
+  using invoke = std::function<R(A...)>;
+};
+
+namespace std::experimental::type_constructible {
+  template <>
+  struct traits<StdFunctionTC> {
+    template <typename R, typename... A, typename F>
+    static auto make(F&& f) {
+      return std::function<R(A...)>(std::forward<F>(f));
+    }
+  };
+}  // namespace std::experimental::type_constructible
+
+#endif  // FUNCTION_TC_H
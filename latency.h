@@ -0,0 +1,242 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "call_site.h"
+
+#if defined(TOBY_LATENCY)
+#include "thread_registry.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+/*!
+= Latency
+
+When TOBY_LATENCY is defined, monad_promise records, for every co_await, the
+time from the coroutine suspending to its being resumed, which is how long the
+bind of the awaited value took to call the continuation. Samples are kept in a
+histogram per call site, that is, per co_await expression in the source, so
+that the co_await that contributes the latency in a long coroutine can be
+found. A co_await that short-circuits is never resumed and records nothing.
+
+Histograms are log-linear, in the style of HdrHistogram: durations are recorded
+in nanoseconds to within one part in 16. Each thread records into its own
+histograms without synchronization beyond relaxed atomics, taking a lock only
+the first time it sees a call site. `dump()` merges them, with those of threads
+that have exited, and `print()` writes a table of percentiles.
+
+When TOBY_LATENCY isn't defined, awaitables don't keep their call sites and
+nothing is recorded; only the empty `await_timer` is declared, and none of the
+histograms. It must be defined, or not, consistently across a program.
+*/
+
+namespace toby::latency {
+#if defined(TOBY_LATENCY)
+  inline constexpr bool enabled = true;
+#else
+  inline constexpr bool enabled = false;
+#endif
+
+  using toby::call_site;
+  using toby::call_site_hash;
+
+  // Times a co_await from suspending to resuming. Awaitables derive from it,
+  // so that when timing is disabled it is empty and takes no space.
+  template <bool = enabled>
+  struct await_timer {
+    constexpr explicit await_timer(call_site) {}
+    void suspended() {}
+    void resumed() {}
+  };
+
+#if defined(TOBY_LATENCY)
+  // Durations below 16ns are recorded exactly; above that, each power of two
+  // is divided into 16 buckets.
+  struct histogram {
+    static constexpr unsigned sub_bits = 4;
+    static constexpr std::size_t sub_buckets = std::size_t(1) << sub_bits;
+    static constexpr std::size_t bucket_count =
+        (64 - sub_bits + 1) * sub_buckets;
+
+    std::array<std::uint64_t, bucket_count> counts{};
+
+    static unsigned log2_floor(std::uint64_t v) {
+#if defined(_MSC_VER)
+      unsigned long i;
+      _BitScanReverse64(&i, v);
+      return unsigned(i);
+#else
+      return 63 - unsigned(__builtin_clzll(v));
+#endif
+    }
+
+    static std::size_t bucket(std::uint64_t ns) {
+      if (ns < sub_buckets) return std::size_t(ns);
+      unsigned e = log2_floor(ns);
+      auto sub = std::size_t(ns >> (e - sub_bits)) & (sub_buckets - 1);
+      return (e - sub_bits + 1) * sub_buckets + sub;
+    }
+
+    // The largest duration that is recorded in bucket i.
+    static std::uint64_t upper_bound(std::size_t i) {
+      if (i < sub_buckets) return i;
+      unsigned e = unsigned(i / sub_buckets) + sub_bits - 1;
+      std::uint64_t lower = (sub_buckets + i % sub_buckets) << (e - sub_bits);
+      return lower + (std::uint64_t(1) << (e - sub_bits)) - 1;
+    }
+
+    std::uint64_t count() const {
+      std::uint64_t n = 0;
+      for (auto c : counts) n += c;
+      return n;
+    }
+
+    // The duration, in nanoseconds, below which a fraction p of the samples
+    // fall, to within the width of a bucket.
+    std::uint64_t percentile(double p) const {
+      auto n = count();
+      if (n == 0) return 0;
+      auto rank = std::uint64_t(p * double(n));
+      if (rank >= n) rank = n - 1;
+      std::uint64_t seen = 0;
+      for (std::size_t i = 0; i < bucket_count; ++i) {
+        seen += counts[i];
+        if (seen > rank) return upper_bound(i);
+      }
+      return upper_bound(bucket_count - 1);
+    }
+
+    histogram& operator+=(histogram const& other) {
+      for (std::size_t i = 0; i < bucket_count; ++i) {
+        counts[i] += other.counts[i];
+      }
+      return *this;
+    }
+  };
+
+  struct site_histogram {
+    call_site site;
+    histogram samples;
+  };
+
+  namespace detail {
+    // A histogram written by one thread and read by others.
+    struct live_histogram {
+      std::array<std::atomic<std::uint64_t>, histogram::bucket_count> counts{};
+
+      void record(std::uint64_t ns) {
+        auto& c = counts[histogram::bucket(ns)];
+        c.store(c.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+      }
+
+      void add_to(histogram& h) const {
+        for (std::size_t i = 0; i < histogram::bucket_count; ++i) {
+          h.counts[i] += counts[i].load(std::memory_order_relaxed);
+        }
+      }
+    };
+
+    using site_map = std::unordered_map<call_site, histogram, call_site_hash>;
+
+    // The histograms of one thread. Only the thread itself adds call sites,
+    // which it does under the lock so that dump can read the map; it looks
+    // them up without one.
+    struct thread_histograms {
+      std::mutex mutex;
+      std::unordered_map<call_site,
+                         std::unique_ptr<live_histogram>,
+                         call_site_hash>
+          sites;
+
+      live_histogram& at(call_site const& site) {
+        auto it = sites.find(site);
+        if (it != sites.end()) return *it->second;
+        std::lock_guard<std::mutex> lock(mutex);
+        return *sites.emplace(site, std::make_unique<live_histogram>())
+                    .first->second;
+      }
+
+      void add_to(site_map& merged) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& [site, h] : sites) h->add_to(merged[site]);
+      }
+
+      void retire(site_map& retired) { add_to(retired); }
+    };
+
+    using registry = thread_registry<thread_histograms, site_map>;
+
+    inline thread_histograms& local() {
+      return registry::local();
+    }
+  }  // namespace detail
+
+  using clock = std::chrono::steady_clock;
+
+  // Records a duration against a call site on this thread.
+  inline void record(call_site const& site, clock::duration d) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    detail::local().at(site).record(ns < 0 ? 0 : std::uint64_t(ns));
+  }
+
+  template <>
+  struct await_timer<true> {
+    call_site site;
+    clock::time_point start;
+
+    explicit await_timer(call_site site) : site(site) {}
+    void suspended() { start = clock::now(); }
+    void resumed() { record(site, clock::now() - start); }
+  };
+
+  // The histograms of every call site, merged over all threads.
+  inline std::vector<site_histogram> dump() {
+    auto merged =
+        detail::registry::access([](auto const& retired, auto const& live) {
+          auto result = retired;
+          for (auto* t : live) t->add_to(result);
+          return result;
+        });
+    std::vector<site_histogram> result;
+    result.reserve(merged.size());
+    for (auto const& [site, h] : merged) result.push_back({site, h});
+    return result;
+  }
+
+  // Writes the number of samples and percentiles of each call site, in
+  // nanoseconds, most frequent first.
+  inline void print(std::ostream& os) {
+    auto sites = dump();
+    std::vector<std::pair<std::uint64_t, site_histogram const*>> order;
+    for (auto const& s : sites) order.emplace_back(s.samples.count(), &s);
+    std::sort(order.begin(), order.end(), [](auto const& a, auto const& b) {
+      return a.first > b.first;
+    });
+    for (auto const& [n, s] : order) {
+      os << s->site.file << ':' << s->site.line << ": " << n
+         << " samples, p50 " << s->samples.percentile(0.5) << "ns, p90 "
+         << s->samples.percentile(0.9) << "ns, p99 "
+         << s->samples.percentile(0.99) << "ns, max "
+         << s->samples.percentile(1.0) << "ns\n";
+    }
+  }
+#endif
+}  // namespace toby::latency
+
+#endif  // LATENCY_H
@@ -0,0 +1,63 @@
+#ifndef LENS_H
+#define LENS_H
+
+// Lenses focus on a part of a larger structure, so that an operation on the
+// part can be applied to the whole without copying the rest of it. The State
+// monads use them to run a computation over a sub-state (see `zoom`).
+//
+// A lens is either a pointer to a data member or a lens object made by
+// make_lens, in one of two forms:
+//
+// - make_lens(view), where view(s) returns an lvalue reference to the part of
+//   s; or
+// - make_lens(get, set), where get(s) returns the part by value and set(s, x)
+//   stores x as the part of s, for parts that are not stored as such.
+
+#include <type_traits>
+#include <utility>
+
+namespace toby {
+  template <typename Get, typename Set>
+  struct lens {
+    Get get;
+    Set set;
+  };
+
+  // The setter of a lens whose getter returns a reference.
+  struct no_setter {};
+
+  template <typename View>
+  constexpr auto make_lens(View&& view) {
+    return lens<std::decay_t<View>, no_setter>{std::forward<View>(view), {}};
+  }
+
+  template <typename Get, typename Set>
+  constexpr auto make_lens(Get&& get, Set&& set) {
+    return lens<std::decay_t<Get>, std::decay_t<Set>>{std::forward<Get>(get),
+                                                       std::forward<Set>(set)};
+  }
+
+  // Calls f with an lvalue referring to the part of s that l focuses on and
+  // returns what f returns. When the lens has a setter, f is given a local copy
+  // of the part which is stored back into s afterwards.
+  template <typename Class, typename Part, typename S, typename F>
+  constexpr decltype(auto) with_focus(Part Class::*l, S& s, F&& f) {
+    return std::forward<F>(f)(s.*l);
+  }
+
+  template <typename Get, typename Set, typename S, typename F>
+  constexpr decltype(auto) with_focus(lens<Get, Set> const& l, S& s, F&& f) {
+    if constexpr (std::is_same_v<Set, no_setter>) {
+      static_assert(std::is_lvalue_reference_v<decltype(l.get(s))>,
+                    "a lens without a setter must return a reference");
+      return std::forward<F>(f)(l.get(s));
+    } else {
+      auto part = l.get(std::as_const(s));
+      auto result = std::forward<F>(f)(part);
+      l.set(s, std::move(part));
+      return result;
+    }
+  }
+}  // namespace toby
+
+#endif  // LENS_H
@@ -2,22 +2,132 @@
 #define MAYBE_H
 
 // Make std::optional behave like the Maybe monad when used in a coroutine.
+//
+// Inside such a coroutine, any nullable type can be co_awaited, not only
+// std::optional: raw pointers, smart pointers, and any type for which
+// nullable_traits is specialized. If the awaited value is null the coroutine
+// returns an empty optional; otherwise co_await yields the value inside it.
 
+#include "call_site.h"
+#include "compiler.h"
+#include "exception_traits.h"
+#include "frame_census.h"
+#include "metrics.h"
 #include "return_object_holder.h"
 
 #include <experimental/coroutine>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <type_traits>
+#include <utility>
+
+// How to test a nullable type N for a value and get the value out. Anything
+// pointer-like, which converts to bool and can be dereferenced, is nullable by
+// default; other types can be made nullable by specializing this with the same
+// three functions as pointer_like_traits.
+template <typename N, typename = void>
+struct nullable_traits {};
+
+template <typename N>
+struct pointer_like_traits {
+  static bool has_value(N const& n) { return static_cast<bool>(n); }
+
+  // The value of a nullable that outlives the co_await, that is, one that was
+  // co_awaited as an lvalue, is referred to rather than copied.
+  template <typename NN>
+  static decltype(auto) value(NN& n) {
+    return *n;
+  }
+
+  // The value of a temporary is copied out of it, as the temporary may share
+  // its value with other objects.
+  static auto take(N&& n) { return std::remove_cvref_t<decltype(*n)>(*n); }
+};
+
+template <typename N>
+struct nullable_traits<N,
+                       std::void_t<decltype(static_cast<bool>(
+                                       std::declval<N const&>())),
+                                   decltype(*std::declval<N&>())>>
+    : pointer_like_traits<N> {};
+
+// A raw pointer doesn't own what it points to, so that outlives the co_await
+// even when the pointer doesn't.
+template <typename T>
+struct nullable_traits<T*> : pointer_like_traits<T*> {
+  static T& take(T* p) { return *p; }
+};
+
+// The value of a temporary unique_ptr or optional is owned by nothing else, so
+// it is moved out.
+template <typename T, typename D>
+struct nullable_traits<std::unique_ptr<T, D>>
+    : pointer_like_traits<std::unique_ptr<T, D>> {
+  static T take(std::unique_ptr<T, D>&& p) { return std::move(*p); }
+};
+
+template <typename T>
+struct nullable_traits<std::optional<T>>
+    : pointer_like_traits<std::optional<T>> {
+  static T take(std::optional<T>&& o) { return std::move(*o); }
+};
+
+template <typename N, typename = void>
+struct is_nullable : std::false_type {};
+template <typename N>
+struct is_nullable<N, std::void_t<decltype(&nullable_traits<N>::has_value)>>
+    : std::true_type {};
+
+template <typename N>
+struct maybe_awaitable;
 
 template <typename T>
 struct maybe_promise {
   return_object_holder<std::optional<T>>* data;
 
-  auto get_return_object() { return make_return_object_holder(data); }
+#if defined(TOBY_METRICS) || defined(TOBY_FRAME_CENSUS)
+  // The call site of operator new is in the coroutine function itself.
+  static void* operator new(
+      std::size_t size,
+      toby::call_site function = toby::call_site::current()) {
+    toby::metrics::add<std::optional<T>>(toby::metrics::counter::frame_bytes,
+                                         size);
+    toby::frame_census::record(function, size);
+    return ::operator new(size);
+  }
+  static void operator delete(void* p) { ::operator delete(p); }
+#endif
+
+  auto get_return_object() {
+    toby::metrics::add<std::optional<T>>(toby::metrics::counter::frames);
+    return make_return_object_holder(data);
+  }
   auto initial_suspend() { return std::experimental::suspend_never{}; }
   auto final_suspend() { return std::experimental::suspend_never{}; }
 
-  void return_value(T x) { data->emplace(std::move(x)); }
-  void unhandled_exception() {}
+  // N is deduced as a reference for an lvalue, which the awaitable then refers
+  // to rather than copying.
+  template <
+      typename N,
+      typename = std::enable_if_t<is_nullable<std::remove_cvref_t<N>>::value>>
+  auto await_transform(N&& n) {
+    toby::metrics::add<std::optional<T>>(toby::metrics::counter::binds);
+    return maybe_awaitable<N>{std::forward<N>(n)};
+  }
+
+  void return_value(T const& x) { data->emplace(x); }
+  void return_value(T&& x) { data->emplace(std::move(x)); }
+  // See exception_traits.h.
+  void unhandled_exception() noexcept(
+      !converts_exceptions<std::optional<T>>::value) {
+    if constexpr (converts_exceptions<std::optional<T>>::value) {
+      data->emplace(exception_traits<std::optional<T>>::from_exception(
+          std::current_exception()));
+    } else {
+      std::terminate();
+    }
+  }
 };
 
 // This makes std::optional<T> useable as a coroutine return type. Strictly, this
@@ -30,22 +140,52 @@ namespace std::experimental {
   };
 }  // namespace std::experimental
 
-template <typename T>
+// The type of a co_await expression whose operand yields R. An optional of a
+// reference_wrapper<T> stands in for an optional<T&>, so it yields a T&.
+template <typename R, typename = std::remove_cvref_t<R>>
+struct maybe_result {
+  using type = R;
+};
+template <typename R, typename T>
+struct maybe_result<R, std::reference_wrapper<T>> {
+  using type = T&;
+};
+
+// N is the type of the nullable being co_awaited: a reference to it if it
+// outlives the co_await, in which case the co_await yields a reference to the
+// value inside it, or the nullable itself if it is a temporary, which the
+// awaitable then owns and takes the value out of.
+template <typename N>
 struct maybe_awaitable {
-  std::optional<T> o;
-  auto await_ready() { return o.has_value(); }
-  auto await_resume() { return *o; }
+  using traits = nullable_traits<std::remove_cvref_t<N>>;
+
+  N n;
+  bool await_ready() { return TOBY_LIKELY(traits::has_value(n)); }
+
+  decltype(auto) value() {
+    if constexpr (std::is_reference_v<N>) {
+      return traits::value(n);
+    } else {
+      return traits::take(std::move(n));
+    }
+  }
 
+  auto await_resume() -> typename maybe_result<
+      decltype(std::declval<maybe_awaitable&>().value())>::type {
+    return value();
+  }
+
+  // Only reached when the nullable is null, so kept out of the way of the code
+  // that carries on with the value.
   template <typename U>
-  void await_suspend(std::experimental::coroutine_handle<maybe_promise<U>> h) {
+  TOBY_COLD TOBY_NOINLINE void await_suspend(
+      std::experimental::coroutine_handle<maybe_promise<U>> h) {
+    toby::metrics::add<std::optional<U>>(toby::metrics::counter::suspends);
+    toby::metrics::add<std::optional<U>>(
+        toby::metrics::counter::short_circuits);
     h.promise().data->emplace(std::nullopt);
     h.destroy();
   }
 };
 
-template <typename T>
-auto operator co_await(std::optional<T> o) {
-  return maybe_awaitable<T>{std::move(o)};
-}
-
 #endif  // MAYBE_H
@@ -0,0 +1,186 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(TOBY_METRICS)
+#include "thread_registry.h"
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <string>
+#include <typeinfo>
+#endif
+
+/*!
+= Metrics
+
+When TOBY_METRICS is defined, monad_promise, maybe_promise and monad_awaitable
+count what they do, separately for each monad type that coroutines return:
+
+* `frames`: coroutine frames created
+* `frame_bytes`: bytes allocated for those frames
+* `frames_reclaimed`: frames destroyed by monad_promise because nothing refers
+  to them any more
+* `suspends` and `resumes`
+* `binds`: values bound to the continuation of a coroutine by co_await
+* `short_circuits`: co_awaits whose continuation was dropped without being
+  invoked, which is what happens when an error or empty value is awaited
+* `max_depth`: the greatest depth that a monad_promise's stack of places to
+  store the results of binds reached
+
+Each thread counts into its own counters, so counting is a load and a store
+with no synchronization. `snapshot()` sums them, with those of threads that
+have exited, by the name of the monad type.
+
+When TOBY_METRICS isn't defined, nothing is counted and the hooks compile to
+nothing. Only the hooks are declared then, without the standard headers that
+counting needs, as every coroutine includes this header; `snapshot()` and the
+rest exist only when counting. It must be defined, or not, consistently across
+a program.
+*/
+
+namespace toby::metrics {
+#if defined(TOBY_METRICS)
+  inline constexpr bool enabled = true;
+#else
+  inline constexpr bool enabled = false;
+#endif
+
+  enum class counter : std::size_t {
+    frames,
+    frame_bytes,
+    frames_reclaimed,
+    suspends,
+    resumes,
+    binds,
+    short_circuits,
+    max_depth,
+  };
+
+  inline constexpr std::size_t counter_count =
+      std::size_t(counter::max_depth) + 1;
+
+  struct counters {
+    std::uint64_t frames = 0;
+    std::uint64_t frame_bytes = 0;
+    std::uint64_t frames_reclaimed = 0;
+    std::uint64_t suspends = 0;
+    std::uint64_t resumes = 0;
+    std::uint64_t binds = 0;
+    std::uint64_t short_circuits = 0;
+    std::uint64_t max_depth = 0;
+
+    std::uint64_t& operator[](counter c) {
+      switch (c) {
+        case counter::frames: return frames;
+        case counter::frame_bytes: return frame_bytes;
+        case counter::frames_reclaimed: return frames_reclaimed;
+        case counter::suspends: return suspends;
+        case counter::resumes: return resumes;
+        case counter::binds: return binds;
+        case counter::short_circuits: return short_circuits;
+        case counter::max_depth: break;
+      }
+      return max_depth;
+    }
+
+    // Accumulates the counts of another thread or monad type.
+    counters& operator+=(counters const& other) {
+      frames += other.frames;
+      frame_bytes += other.frame_bytes;
+      frames_reclaimed += other.frames_reclaimed;
+      suspends += other.suspends;
+      resumes += other.resumes;
+      binds += other.binds;
+      short_circuits += other.short_circuits;
+      if (other.max_depth > max_depth) max_depth = other.max_depth;
+      return *this;
+    }
+  };
+
+#if defined(TOBY_METRICS)
+  namespace detail {
+    // The counters of one monad type on one thread. Only that thread writes
+    // them, but snapshot reads them from others, hence the atomics.
+    struct thread_counters {
+      char const* name;
+      std::array<std::atomic<std::uint64_t>, counter_count> values{};
+
+      explicit thread_counters(char const* name) : name(name) {}
+
+      counters load() const {
+        counters c;
+        for (std::size_t i = 0; i < counter_count; ++i) {
+          c[counter(i)] = values[i].load(std::memory_order_relaxed);
+        }
+        return c;
+      }
+
+      // Folds the counters into those of exited threads.
+      void retire(std::map<std::string, counters>& retired) const {
+        retired[name] += load();
+      }
+    };
+
+    using registry =
+        thread_registry<thread_counters, std::map<std::string, counters>>;
+
+    template <typename M>
+    thread_counters& local() {
+      return registry::local<M>(typeid(M).name());
+    }
+  }  // namespace detail
+
+  // Adds n to a counter of monad type M on this thread.
+  template <typename M>
+  void add(counter c, std::uint64_t n = 1) {
+    auto& v = detail::local<M>().values[std::size_t(c)];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // Raises a counter of monad type M on this thread to n if it is lower.
+  template <typename M>
+  void record_max(counter c, std::uint64_t n) {
+    auto& v = detail::local<M>().values[std::size_t(c)];
+    if (n > v.load(std::memory_order_relaxed)) {
+      v.store(n, std::memory_order_relaxed);
+    }
+  }
+
+  // The counters of every monad type, summed over all threads, by the name of
+  // the type as given by typeid.
+  inline std::map<std::string, counters> snapshot() {
+    return detail::registry::access([](auto const& retired, auto const& live) {
+      auto result = retired;
+      for (auto const* c : live) result[c->name] += c->load();
+      return result;
+    });
+  }
+
+  // The counters of monad type M, summed over all threads.
+  template <typename M>
+  counters snapshot_of() {
+    auto all = snapshot();
+    auto it = all.find(typeid(M).name());
+    return it == all.end() ? counters{} : it->second;
+  }
+
+  // The counters of all monad types together.
+  inline counters total() {
+    counters result;
+    for (auto const& [name, c] : snapshot()) result += c;
+    return result;
+  }
+#else
+  template <typename M>
+  void add(counter, std::uint64_t = 1) {}
+
+  template <typename M>
+  void record_max(counter, std::uint64_t) {}
+#endif
+}  // namespace toby::metrics
+
+#endif  // METRICS_H
@@ -1,7 +1,15 @@
 #ifndef MONAD_PROMISE_H
 #define MONAD_PROMISE_H
 
+#include "async_stack.h"
+#include "call_site.h"
+#include "compiler.h"
+#include "exception_traits.h"
+#include "frame_census.h"
+#include "latency.h"
+#include "metrics.h"
 #include "return_object_holder.h"
+#include "trace.h"
 
 #include <experimental/functor.hpp>
 #include <experimental/fundamental/v3/value_type.hpp>
@@ -9,15 +17,125 @@
 #include <experimental/monad.hpp>
 
 #include <experimental/coroutine>
-#include <iostream>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-template <typename M, typename F>
-auto operator>>=(M&& m, F&& f)
-    -> decltype(std::experimental::monad::bind(std::forward<M>(m),
-                                               std::forward<F>(f))) {
-  return std::experimental::monad::bind(std::forward<M>(m), std::forward<F>(f));
+// Opt-in customization point: if fuses_binds<M>::value is true, a chain of >>=
+// starting from an M, such as (m >>= f) >>= g, is not evaluated one bind at a
+// time but builds a bind_expr. This performs the binds right-nested, as in
+// m >>= [](auto x) { return f(x) >>= g; }, so that a failure at any step
+// returns straight out of the whole chain and the result of each step is bound
+// where it is produced rather than being moved into the next bind. Because it
+// changes the type of a >>= expression, it is opt-in. The functions are moved
+// into the continuations passed to bind, so a bind may keep its continuation,
+// and call it more than once if the functions can be copied.
+template <typename M>
+struct fuses_binds : std::false_type {};
+
+// The std-make monad traits of M. The binds below call these directly, rather
+// than through std::experimental::monad::bind, which only forwards to them but
+// isn't inlined in an unoptimized build.
+template <typename M>
+using monad_traits_t = std::experimental::monad::traits<
+    std::experimental::type_constructor_t<std::remove_cvref_t<M>>>;
+
+template <typename M, typename... F>
+struct bind_expr {
+  M m;
+  std::tuple<F...> fs;
+
+  // Evaluates the chain, which may be done once only.
+  auto eval() && { return eval_from<0>(std::move(m), std::move(fs)); }
+
+  // Self makes the constraint dependent, so that it is not checked before the
+  // return type of eval has been deduced.
+  template <typename R,
+            typename Self = bind_expr,
+            typename = std::enable_if_t<std::is_constructible_v<
+                R,
+                decltype(std::declval<Self>().eval())>>>
+  operator R() && {
+    return std::move(*this).eval();
+  }
+
+ private:
+  // The continuation that binds the result of the Ith function to the rest of
+  // the chain. It owns the functions, as a bind may keep it and call it after
+  // the bind_expr is gone, as State's does. Called as an rvalue it hands them
+  // on; called as an lvalue, by a bind that may call it again, it copies them.
+  template <std::size_t I>
+  struct continuation {
+    std::tuple<F...> fs;
+
+    template <typename X>
+    auto operator()(X&& x) && {
+      return eval_from<I + 1>(std::get<I>(std::move(fs))(std::forward<X>(x)),
+                              std::move(fs));
+    }
+    template <typename X>
+    auto operator()(X&& x) const& {
+      return eval_from<I + 1>(std::get<I>(fs)(std::forward<X>(x)), fs);
+    }
+  };
+
+  template <std::size_t I, typename N>
+  static auto eval_from(N&& n, std::tuple<F...> fs) {
+    if constexpr (I + 1 == sizeof...(F)) {
+      return monad_traits_t<N>::bind(std::forward<N>(n),
+                                     std::get<I>(std::move(fs)));
+    } else {
+      return monad_traits_t<N>::bind(std::forward<N>(n),
+                                     continuation<I>{std::move(fs)});
+    }
+  }
+};
+
+// How bind_expr stores a function. Functions are kept as references rather
+// than decaying to pointers, which compilers don't reliably see through.
+template <typename F>
+using bind_expr_function_t =
+    std::conditional_t<std::is_function_v<std::remove_reference_t<F>>,
+                       F,
+                       std::decay_t<F>>;
+
+template <typename M>
+struct is_bind_expr : std::false_type {};
+template <typename M, typename... F>
+struct is_bind_expr<bind_expr<M, F...>> : std::true_type {};
+
+template <typename M,
+          typename F,
+          typename = std::enable_if_t<
+              !fuses_binds<std::remove_cvref_t<M>>::value &&
+              !is_bind_expr<std::remove_cvref_t<M>>::value>>
+TOBY_FORWARDER auto operator>>=(M&& m, F&& f)
+    -> decltype(monad_traits_t<M>::bind(std::forward<M>(m),
+                                        std::forward<F>(f))) {
+  return monad_traits_t<M>::bind(std::forward<M>(m), std::forward<F>(f));
+}
+
+template <
+    typename M,
+    typename F,
+    typename = std::enable_if_t<fuses_binds<std::remove_cvref_t<M>>::value>,
+    typename = void>
+TOBY_FORWARDER auto operator>>=(M&& m, F&& f) {
+  return bind_expr<std::remove_cvref_t<M>, bind_expr_function_t<F>>{
+      std::forward<M>(m), {std::forward<F>(f)}};
+}
+
+template <typename M, typename... F, typename G>
+auto operator>>=(bind_expr<M, F...>&& e, G&& g) {
+  return bind_expr<M, F..., bind_expr_function_t<G>>{
+      std::move(e.m),
+      std::tuple_cat(std::move(e.fs),
+                     std::tuple<bind_expr_function_t<G>>(std::forward<G>(g)))};
 }
 
 template <typename P>
@@ -26,21 +144,15 @@ struct intrusive_coroutine_handle {
   handle_type h = {};
 
   intrusive_coroutine_handle() = default;
-  intrusive_coroutine_handle(handle_type h) : h(h) {
-    // Note that we don't increment the reference count stored in h.promise()
-    // here. This is because of the way the promise itself holds a
-    // shared_coroutine_handle to itself.
+  explicit intrusive_coroutine_handle(handle_type h) : h(h) {
+    h.promise().inc_ref();
   }
   intrusive_coroutine_handle(intrusive_coroutine_handle const& o)
       : intrusive_coroutine_handle() {
     *this = o;
-    std::cout << this << ": shared_coroutine_handle copy constructor: h = "
-              << h.address() << std::endl;
   }
   intrusive_coroutine_handle(intrusive_coroutine_handle&& o) noexcept {
     h = std::exchange(o.h, {});
-    std::cout << this << ": shared_coroutine_handle move constructor: h = "
-              << h.address() << std::endl;
   }
 
   intrusive_coroutine_handle& operator=(intrusive_coroutine_handle const& o) {
@@ -55,23 +167,66 @@ struct intrusive_coroutine_handle {
     return *this;
   }
 
-  ~intrusive_coroutine_handle() {
-    std::cout << this << ": ~shared_coroutine_handle: h = " << h.address()
-              << std::endl;
-    reset();
-  }
+  ~intrusive_coroutine_handle() { reset(); }
 
-  void reset() {
+  TOBY_FORWARDER void reset() {
     auto h2 = std::exchange(h, {});
     if (h2) h2.promise().dec_ref();
   }
 };
 
+// How monad_awaitable binds the value being awaited to the continuation of the
+// coroutine. By default this goes through the monad customization points, which
+// requires the awaited value to have been converted to the monad first.
 template <typename M>
+struct monad_bind_traits {
+  using value_type = std::experimental::value_type_t<M>;
+
+  template <typename K>
+  TOBY_FORWARDER static auto bind(M&& x, K&& k) {
+    return monad_traits_t<M>::bind(std::move(x), std::forward<K>(k));
+  }
+};
+
+// Customization point allowing a value of type N to be co_awaited in a
+// coroutine returning M without first converting it to M, which for type-erased
+// monads usually means an allocation per co_await. Specializations provide the
+// same members as monad_bind_traits, with bind taking an N and returning
+// something that M can be constructed from.
+template <typename M, typename N, typename = void>
+struct direct_bind_traits {};
+
+// Opt-in customization point: if yields_reference<M>::value is true, co_await
+// on an lvalue M in a coroutine returning the same kind of monad yields a const
+// reference to the value inside it instead of a copy. This requires the monad's
+// bind, called on a const lvalue, to pass its continuation a reference to that
+// value, and the awaited object to outlive the co_await, as a named variable
+// does.
+template <typename M>
+struct yields_reference : std::false_type {};
+
+template <typename M>
+struct reference_bind_traits {
+  using value_type = std::experimental::value_type_t<M> const&;
+
+  template <typename K>
+  TOBY_FORWARDER static auto bind(M const& x, K&& k) {
+    return monad_traits_t<M>::bind(x, std::forward<K>(k));
+  }
+};
+
+template <typename M, typename Traits = monad_bind_traits<M>>
 struct monad_awaitable;
 
+// A place for the result of a bind, on the stack that monad_promise keeps.
 template <typename M>
-struct monad_promise {
+struct bind_storage {
+  deferred<M> value;
+  bind_storage* below;
+};
+
+template <typename M>
+struct monad_promise : toby::async_stack::activation<> {
   using handle_type = std::experimental::coroutine_handle<monad_promise>;
 
   // So that we can defer initialization of the return object until we know
@@ -79,95 +234,116 @@ struct monad_promise {
   return_object_holder<M>* return_object;
 
   // A stack of places to store the results of the monadic bind operations.
-  // These pointers point either into the return object in the coroutine frame
-  // (the bottom of the stack) or to local variables in the continuations passed
-  // to bind (the rest of the stack).
-  std::vector<deferred<M>*> bind_return_storage;
+  // They are local variables of the continuations passed to bind, linked
+  // through themselves so that pushing and popping them allocates nothing.
+  // Below them all is the return object.
+  bind_storage<M>* bind_return_storage = nullptr;
+  // The height of the stack, counting the return object, for the metrics.
+  std::size_t bind_depth = 1;
 
   int ref_count = 0;
-  // The use of unique_ptr here is because MSVC 14.11 can't instantiate
-  // coroutine_handle for an incomplete type.
-  std::unique_ptr<intrusive_coroutine_handle<monad_promise>> pich =
-      std::make_unique<intrusive_coroutine_handle<monad_promise>>(
-          handle_type::from_promise(*this));
-  intrusive_coroutine_handle<monad_promise>& ich = *pich;
   int susp_count = 0;
 
-  ~monad_promise() { std::cout << this << ": ~monad_promise" << std::endl; }
+  ~monad_promise() {
+    toby::trace::record(toby::trace::event::destroy, frame_address());
+  }
 
-  void push_storage(deferred<M>& storage) {
-    bind_return_storage.push_back(&storage);
+  TOBY_FORWARDER void* frame_address() {
+    return handle_type::from_promise(*this).address();
+  }
+
+  void push_storage(bind_storage<M>& storage) {
+    storage.below = std::exchange(bind_return_storage, &storage);
+    if constexpr (toby::metrics::enabled) {
+      toby::metrics::record_max<M>(toby::metrics::counter::max_depth,
+                                   ++bind_depth);
+    }
   }
 
   template <typename... Args>
-  void emplace_value(Args&&... args) {
-    auto storage = bind_return_storage.back();
-    if (storage != &return_object->stage) {
-      std::cout << this << ": setting bind_return_storage" << std::endl;
+  TOBY_FORWARDER void emplace_value(Args&&... args) {
+    if (auto storage = bind_return_storage) {
+      bind_return_storage = storage->below;
+      if constexpr (toby::metrics::enabled) --bind_depth;
+      storage->value.emplace(std::forward<Args>(args)...);
     } else {
-      std::cout << this << ": setting stage" << std::endl;
+      return_object->emplace(std::forward<Args>(args)...);
     }
-    storage->emplace(std::forward<Args>(args)...);
-    bind_return_storage.pop_back();
   }
 
-  void inc_ref() {
+  TOBY_FORWARDER void inc_ref() {
     ++ref_count;
-    std::cout << this << ": inc_ref -> " << ref_count << std::endl;
   }
 
-  void dec_ref() {
+  TOBY_FORWARDER void dec_ref() {
     --ref_count;
-    std::cout << this << ": dec_ref -> " << ref_count << std::endl;
     maybe_destroy();
   }
 
   void on_suspend() {
+    deactivate();
     ++susp_count;
+    toby::metrics::add<M>(toby::metrics::counter::suspends);
     // susp_count should always be == 1 here
-    std::cout << this << ": on_suspend -> " << susp_count << std::endl;
+    toby::trace::record(toby::trace::event::suspend, frame_address());
     maybe_destroy();
   }
 
   void on_resume() {
     --susp_count;
+    toby::metrics::add<M>(toby::metrics::counter::resumes);
     // susp_count should always be == 0 here
-    std::cout << this << ": on_resume -> " << susp_count << std::endl;
+    toby::trace::record(toby::trace::event::resume, frame_address());
   }
 
   // We destroy the coroutine if it is suspended and unreferenced. If it is not
   // suspended then it will flow off the end and be destroyed automatically. If
   // it is unreferenced then we know it will never be resumed, so needs to be
   // destroyed,
-  void maybe_destroy() {
-    if (susp_count > 0 && ref_count == 0) {
-      handle_type::from_promise(*this).destroy();
-    }
+  //
+  // This happens once per coroutine but is checked every time a reference is
+  // dropped, which is at least once per co_await, so the destruction of the
+  // frame is kept out of line.
+  TOBY_FORWARDER void maybe_destroy() {
+    if (TOBY_UNLIKELY(susp_count > 0 && ref_count == 0)) destroy();
   }
 
-  auto get_return_object() { return make_return_object_holder(return_object); }
+  TOBY_NOINLINE void destroy() {
+    toby::metrics::add<M>(toby::metrics::counter::frames_reclaimed);
+    handle_type::from_promise(*this).destroy();
+  }
+
+#if defined(TOBY_METRICS) || defined(TOBY_FRAME_CENSUS)
+  // The call site of operator new is in the coroutine function itself.
+  static void* operator new(
+      std::size_t size,
+      toby::call_site function = toby::call_site::current()) {
+    toby::metrics::add<M>(toby::metrics::counter::frame_bytes, size);
+    toby::frame_census::record(function, size);
+    return ::operator new(size);
+  }
+  static void operator delete(void* p) { ::operator delete(p); }
+#endif
+
+  auto get_return_object() {
+    toby::metrics::add<M>(toby::metrics::counter::frames);
+    toby::trace::record(toby::trace::event::create, frame_address());
+    return make_return_object_holder(return_object);
+  }
 
   auto initial_suspend() {
-    // N4680 says that get_return_object is called before initial_suspend, but
-    // MSVC 14.1 calls initial_suspend first. However, it does call
-    // get_return_object before calling await_ready on the result of
-    // initial_suspend().
+    // The coroutine is the one running on this thread from its start.
     struct suspend : std::experimental::suspend_never {
       monad_promise* p;
       suspend(monad_promise* p) : p(p) {}
       bool await_ready() {
-        // The first item on the stack of places to store the results of bind
-        // is the return value of the coroutine itself.
-        // We rely on get_return_object having been called already as required
-        // by N4680.
-        p->bind_return_storage.push_back(&p->return_object->stage);
+        p->activate(p->frame_address(), nullptr);
         return true;
       }
     };
     return suspend(this);
   }
   auto final_suspend() {
-    std::cout << this << ": final_suspend" << std::endl;
     struct suspend : std::experimental::suspend_always {
       void await_suspend(handle_type h) { h.promise().on_suspend(); }
     };
@@ -177,15 +353,47 @@ struct monad_promise {
   using TC = std::experimental::type_constructor_t<M>;
   using ValueType = std::experimental::value_type_t<M>;
 
+  // Whether co_await on an N, which is convertible to O, yields a reference.
+  template <typename N, typename O>
+  static constexpr bool awaits_reference =
+      std::is_lvalue_reference_v<N> &&
+      std::is_same_v<std::remove_cvref_t<N>, O> && yields_reference<O>::value;
+
   // co_await is allowed for any type N such that we can construct a value of
   // our monad with N
   template <
       typename N,
       typename U = std::experimental::value_type_t<std::remove_cvref_t<N>>,
       typename O = std::experimental::meta::invoke<TC, U>,
-      typename = std::enable_if_t<std::is_constructible_v<O, N>>>
-  auto await_transform(N&& m) {
-    return monad_awaitable<O>{std::forward<N>(m)};
+      typename = std::enable_if_t<std::is_constructible_v<O, N> &&
+                                  !awaits_reference<N, O>>>
+  TOBY_FORWARDER auto await_transform(
+      N&& m, toby::call_site site = toby::call_site::current()) {
+    return monad_awaitable<O>{std::forward<N>(m), site};
+  }
+
+  // co_await on an lvalue of a monad that opts in with yields_reference is
+  // allowed without copying it, and yields a reference.
+  template <
+      typename N,
+      typename U = std::experimental::value_type_t<std::remove_cvref_t<N>>,
+      typename O = std::experimental::meta::invoke<TC, U>,
+      typename = std::enable_if_t<awaits_reference<N, O>>,
+      typename = void>
+  TOBY_FORWARDER auto await_transform(
+      N&& m, toby::call_site site = toby::call_site::current()) {
+    return monad_awaitable<O const&, reference_bind_traits<O>>{m, site};
+  }
+
+  // co_await is also allowed for any type N that knows how to bind itself
+  // directly into our monad.
+  template <typename N,
+            typename Traits = direct_bind_traits<M, std::remove_cvref_t<N>>,
+            typename = typename Traits::value_type>
+  TOBY_FORWARDER auto await_transform(
+      N&& m, toby::call_site site = toby::call_site::current()) {
+    return monad_awaitable<std::remove_cvref_t<N>, Traits>{std::forward<N>(m),
+                                                           site};
   }
 
   template <typename T>
@@ -195,32 +403,41 @@ struct monad_promise {
       // pure
       return_value(std::experimental::make<TC>(std::forward<T>(x)));
     } else {
-      std::cout << this << ": return_value called" << std::endl;
+      toby::trace::record(toby::trace::event::return_value, frame_address());
       emplace_value(std::forward<T>(x));
     }
   }
 
-  void unhandled_exception() {}
+  // See exception_traits.h.
+  void unhandled_exception() noexcept(!converts_exceptions<M>::value) {
+    if constexpr (converts_exceptions<M>::value) {
+      emplace_value(
+          exception_traits<M>::from_exception(std::current_exception()));
+    } else {
+      std::terminate();
+    }
+  }
 };
 
-template <typename M>
-struct monad_awaitable {
+template <typename M, typename Traits>
+struct monad_awaitable : toby::latency::await_timer<>,
+                         toby::async_stack::awaiting<> {
   M x;
-  using T = std::experimental::value_type_t<M>;
-  deferred<T> result;
+  using T = typename Traits::value_type;
+  // An optional can't hold a reference, so references are stored wrapped.
+  using stored_type = std::conditional_t<
+      std::is_reference_v<T>,
+      std::reference_wrapper<std::remove_reference_t<T>>,
+      T>;
+  deferred<stored_type> result;
 
-  monad_awaitable(M x) : x(std::move(x)) {
-    std::cout << this << ": monad_awaitable()" << std::endl;
-  }
-
-  ~monad_awaitable() {
-    std::cout << this << ": ~monad_awaitable()" << std::endl;
-  }
+  monad_awaitable(M x, toby::call_site site)
+      : await_timer(site), awaiting(site), x(std::forward<M>(x)) {}
 
-  constexpr bool await_ready() noexcept { return false; }
+  TOBY_FORWARDER constexpr bool await_ready() noexcept { return false; }
 
-  constexpr auto await_resume() noexcept {
-    std::cout << this << ": await_resume" << std::endl;
+  TOBY_FORWARDER constexpr T await_resume() noexcept {
+    resumed();
     return std::move(*result);
   }
 
@@ -235,36 +452,44 @@ struct monad_awaitable {
     continuation& operator=(continuation const&) = delete;
     continuation& operator=(continuation&&) = delete;
 
+    // A continuation that still refers to the coroutine when it is destroyed
+    // was never invoked, so the coroutine short-circuited.
+    ~continuation() {
+      if (ich.h) toby::metrics::add<N>(toby::metrics::counter::short_circuits);
+    }
+
     template <typename T>
     auto operator()(T&& x) && {
-      std::cout << &awaitable << ": continuation invoked" << std::endl;
-      if (!ich.h)
-        throw std::logic_error(
-            "coroutine continuation invoked after being moved from");
+      if (TOBY_UNLIKELY(!ich.h)) throw_moved_from();
       auto local_ich = std::move(ich);
       auto& h = local_ich.h;
       // Set the value to be returned from co_await
       awaitable.result.emplace(std::forward<decltype(x)>(x));
-      std::cout << this << ": calling resume on " << h.address() << std::endl;
       // Provide storage for the return value
-      deferred<N> storage;
+      bind_storage<N> storage;
       h.promise().push_storage(storage);
       // Let the promise know that the coroutine is (about to be) resumed.
       h.promise().on_resume();
+      h.promise().activate(h.address(), awaitable.entry());
       // Resume the coroutine, returning from co_await
       h.resume();
-      std::cout << this << ": resume returned " << std::endl;
       // Return the result of the next bind or co_return
-      std::cout << this << ": bind returning" << std::endl;
-      return *storage;
+      return std::move(*storage.value);
+    }
+
+   private:
+    [[noreturn]] TOBY_COLD TOBY_NOINLINE static void throw_moved_from() {
+      TOBY_THROW(std::logic_error(
+          "coroutine continuation invoked after being moved from"));
     }
   };
 
   template <typename N>
   void await_suspend(std::experimental::coroutine_handle<monad_promise<N>> h) {
+    suspended();
     // Register that we require the coroutine to stay alive so that we can write
     // the return value into it.
-    auto ich = h.promise().ich;
+    auto ich = intrusive_coroutine_handle<monad_promise<N>>(h);
     // Let the promise know that the coroutine is suspended.
     h.promise().on_suspend();
 
@@ -273,12 +498,14 @@ struct monad_awaitable {
     // stays alive so that it can receive the return value of future suspend
     // points.
     auto k = continuation<N>{*this, ich};
+
     // We call bind with the value that was co_awaited and our continuation. The
     // implementation of bind can choose to call the continuation before
     // returning or some time later or never.
-    std::cout << this << ": calling bind" << std::endl;
-    auto tmp = std::experimental::monad::bind(std::move(x), std::move(k));
-    std::cout << this << ": bind returned" << std::endl;
+    toby::trace::record(toby::trace::event::bind, h.address());
+    toby::metrics::add<N>(toby::metrics::counter::binds);
+    [[maybe_unused]] auto in_bind = enter(h.address());
+    auto tmp = Traits::bind(std::forward<M>(x), std::move(k));
     h.promise().emplace_value(std::move(tmp));
   }
 };
@@ -0,0 +1,541 @@
+#ifndef PERSISTENT_H
+#define PERSISTENT_H
+
+#include "compiler.h"
+#include "state.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*!
+= Persistent containers
+
+Because the State monad threads its state through a computation by value,
+keeping a history of states, or branching on one, means copying it. With a
+`std::map` or `std::vector` as the state that is a copy of every element.
+
+The containers here are persistent: an update returns a new container that
+shares all but O(log n) of its structure with the old one, which is left
+unchanged, so a snapshot of the state is just a copy of a pointer.
+
+- `vector<T>` is a bit-partitioned trie with 32-way branching, as in Clojure's
+  vectors or the RRB-vectors of immer, without the relaxed nodes that RRB-trees
+  add for concatenation.
+- `map<K, V>` is a hash array mapped trie in the compressed (CHAMP) layout.
+
+Updates through an rvalue container, and through a `transient` obtained from
+one, reuse in place any node that is not shared with another container, so a
+batch of updates to a container that has not been snapshotted is about as cheap
+as it would be with a mutable container.
+*/
+
+namespace toby::persistent {
+  // Returns a node that the caller may modify: n itself if in_place is set and
+  // nothing else refers to n, otherwise a copy of it.
+  template <typename Node>
+  std::shared_ptr<Node> edit(std::shared_ptr<Node> n, bool in_place) {
+    if (in_place && n.use_count() == 1) return n;
+    return std::make_shared<Node>(*n);
+  }
+
+  template <typename T>
+  class vector {
+    static constexpr unsigned bits = 5;
+    static constexpr std::size_t width = std::size_t(1) << bits;
+    static constexpr std::size_t mask = width - 1;
+
+    // A leaf at shift 0 holds up to 32 values; an inner node holds up to 32
+    // children, each covering 2^shift elements.
+    struct node {
+      std::vector<std::shared_ptr<node>> children;
+      std::vector<T> values;
+    };
+    using node_ptr = std::shared_ptr<node>;
+
+    node_ptr root;
+    std::size_t count = 0;
+    unsigned shift = 0;
+
+    static node_ptr new_path(unsigned shift, T&& x) {
+      auto n = std::make_shared<node>();
+      if (shift == 0) {
+        n->values.reserve(width);
+        n->values.push_back(std::move(x));
+      } else {
+        n->children.push_back(new_path(shift - bits, std::move(x)));
+      }
+      return n;
+    }
+
+    static node_ptr push_into(node_ptr n,
+                              unsigned shift,
+                              std::size_t i,
+                              T&& x,
+                              bool in_place) {
+      n = edit(std::move(n), in_place);
+      if (shift == 0) {
+        n->values.push_back(std::move(x));
+      } else {
+        auto child = (i >> shift) & mask;
+        if (child < n->children.size()) {
+          n->children[child] = push_into(std::move(n->children[child]),
+                                         shift - bits, i, std::move(x),
+                                         in_place);
+        } else {
+          n->children.push_back(new_path(shift - bits, std::move(x)));
+        }
+      }
+      return n;
+    }
+
+    template <typename F>
+    static node_ptr update_in(node_ptr n,
+                              unsigned shift,
+                              std::size_t i,
+                              F& f,
+                              bool in_place) {
+      n = edit(std::move(n), in_place);
+      if (shift == 0) {
+        auto& x = n->values[i & mask];
+        x = f(std::move(x));
+      } else {
+        auto& child = n->children[(i >> shift) & mask];
+        child = update_in(std::move(child), shift - bits, i, f, in_place);
+      }
+      return n;
+    }
+
+    vector push_back_impl(T&& x, bool in_place) && {
+      if (!root) {
+        root = new_path(0, std::move(x));
+      } else if (count == (width << shift)) {
+        auto new_root = std::make_shared<node>();
+        new_root->children.push_back(std::move(root));
+        new_root->children.push_back(new_path(shift, std::move(x)));
+        root = std::move(new_root);
+        shift += bits;
+      } else {
+        root = push_into(std::move(root), shift, count, std::move(x), in_place);
+      }
+      ++count;
+      return std::move(*this);
+    }
+
+    template <typename F>
+    vector update_impl(std::size_t i, F& f, bool in_place) && {
+      if (i >= count) {
+        TOBY_THROW(std::out_of_range("persistent::vector::update"));
+      }
+      root = update_in(std::move(root), shift, i, f, in_place);
+      return std::move(*this);
+    }
+
+   public:
+    using value_type = T;
+
+    class transient;
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T const& operator[](std::size_t i) const {
+      node const* n = root.get();
+      for (auto s = shift; s > 0; s -= bits) {
+        n = n->children[(i >> s) & mask].get();
+      }
+      return n->values[i & mask];
+    }
+
+    T const& at(std::size_t i) const {
+      if (i >= count) {
+        TOBY_THROW(std::out_of_range("persistent::vector::at"));
+      }
+      return (*this)[i];
+    }
+
+    vector push_back(T x) const& {
+      return vector(*this).push_back_impl(std::move(x), false);
+    }
+    vector push_back(T x) && {
+      return std::move(*this).push_back_impl(std::move(x), true);
+    }
+
+    // Returns a vector with the i'th element replaced by f applied to it.
+    template <typename F>
+    vector update(std::size_t i, F f) const& {
+      return vector(*this).update_impl(i, f, false);
+    }
+    template <typename F>
+    vector update(std::size_t i, F f) && {
+      return std::move(*this).update_impl(i, f, true);
+    }
+
+    vector set(std::size_t i, T x) const& {
+      return update(i, [&](T&&) { return std::move(x); });
+    }
+    vector set(std::size_t i, T x) && {
+      return std::move(*this).update(i, [&](T&&) { return std::move(x); });
+    }
+
+    template <typename F>
+    void for_each(F&& f) const {
+      for (std::size_t i = 0; i < count; ++i) f((*this)[i]);
+    }
+
+    transient make_transient() const& { return transient(*this); }
+    transient make_transient() && { return transient(std::move(*this)); }
+  };
+
+  // A mutable view of a persistent vector for batches of updates. Nodes that
+  // were shared with other vectors when the transient was made are copied on
+  // first update; after that, updates are made in place.
+  template <typename T>
+  class vector<T>::transient {
+    vector v;
+
+   public:
+    explicit transient(vector v) : v(std::move(v)) {}
+
+    std::size_t size() const { return v.size(); }
+    T const& operator[](std::size_t i) const { return v[i]; }
+
+    void push_back(T x) { v = std::move(v).push_back(std::move(x)); }
+    void set(std::size_t i, T x) { v = std::move(v).set(i, std::move(x)); }
+    template <typename F>
+    void update(std::size_t i, F f) {
+      v = std::move(v).update(i, std::move(f));
+    }
+
+    vector persistent() && { return std::move(v); }
+  };
+
+  template <typename K,
+            typename V,
+            typename Hash = std::hash<K>,
+            typename Equal = std::equal_to<K>>
+  class map {
+    static constexpr unsigned bits = 5;
+    static constexpr unsigned hash_bits =
+        std::numeric_limits<std::size_t>::digits;
+
+    using entry = std::pair<K, V>;
+
+    // Entries and children are stored densely, ordered by the position of
+    // their bits in datamap and nodemap respectively. Below the last level of
+    // hash bits, nodes hold only entries, unordered, whose keys collide.
+    struct node {
+      std::uint32_t datamap = 0;
+      std::uint32_t nodemap = 0;
+      std::vector<entry> entries;
+      std::vector<std::shared_ptr<node>> children;
+    };
+    using node_ptr = std::shared_ptr<node>;
+
+    node_ptr root = std::make_shared<node>();
+    std::size_t count = 0;
+
+    static std::uint32_t bit_for(std::size_t hash, unsigned shift) {
+      return std::uint32_t(1) << ((hash >> shift) & 31);
+    }
+    static std::size_t index(std::uint32_t bitmap, std::uint32_t bit) {
+      return std::bitset<32>(bitmap & (bit - 1)).count();
+    }
+
+    static std::size_t hash_of(K const& k) { return Hash{}(k); }
+
+    static node_ptr pair_node(unsigned shift,
+                              entry a,
+                              std::size_t ha,
+                              entry b,
+                              std::size_t hb) {
+      auto n = std::make_shared<node>();
+      if (shift >= hash_bits) {
+        n->entries.push_back(std::move(a));
+        n->entries.push_back(std::move(b));
+        return n;
+      }
+      auto bit_a = bit_for(ha, shift);
+      auto bit_b = bit_for(hb, shift);
+      if (bit_a == bit_b) {
+        n->nodemap = bit_a;
+        n->children.push_back(
+            pair_node(shift + bits, std::move(a), ha, std::move(b), hb));
+      } else {
+        n->datamap = bit_a | bit_b;
+        if (bit_b < bit_a) std::swap(a, b);
+        n->entries.push_back(std::move(a));
+        n->entries.push_back(std::move(b));
+      }
+      return n;
+    }
+
+    static V const* find_in(node const* n,
+                            unsigned shift,
+                            std::size_t hash,
+                            K const& key) {
+      for (;; shift += bits) {
+        if (shift >= hash_bits) {
+          for (auto& e : n->entries) {
+            if (Equal{}(e.first, key)) return &e.second;
+          }
+          return nullptr;
+        }
+        auto bit = bit_for(hash, shift);
+        if (n->datamap & bit) {
+          auto& e = n->entries[index(n->datamap, bit)];
+          return Equal{}(e.first, key) ? &e.second : nullptr;
+        }
+        if (!(n->nodemap & bit)) return nullptr;
+        n = n->children[index(n->nodemap, bit)].get();
+      }
+    }
+
+    // Sets key to f applied to its current value, or to nothing if there is
+    // none. Sets added if the key was not already present.
+    template <typename F>
+    static node_ptr update_in(node_ptr n,
+                              unsigned shift,
+                              std::size_t hash,
+                              K const& key,
+                              F& f,
+                              bool& added,
+                              bool in_place) {
+      if (shift >= hash_bits) {
+        n = edit(std::move(n), in_place);
+        for (auto& e : n->entries) {
+          if (Equal{}(e.first, key)) {
+            e.second = f(&e.second);
+            return n;
+          }
+        }
+        n->entries.emplace_back(key, f(static_cast<V*>(nullptr)));
+        added = true;
+        return n;
+      }
+      auto bit = bit_for(hash, shift);
+      if (n->datamap & bit) {
+        auto i = index(n->datamap, bit);
+        n = edit(std::move(n), in_place);
+        if (Equal{}(n->entries[i].first, key)) {
+          n->entries[i].second = f(&n->entries[i].second);
+          return n;
+        }
+        // Push the existing entry down into a new node along with the new one.
+        auto existing = std::move(n->entries[i]);
+        auto existing_hash = hash_of(existing.first);
+        n->entries.erase(n->entries.begin() + i);
+        n->datamap ^= bit;
+        n->children.insert(
+            n->children.begin() + index(n->nodemap, bit),
+            pair_node(shift + bits, std::move(existing), existing_hash,
+                      entry(key, f(static_cast<V*>(nullptr))), hash));
+        n->nodemap |= bit;
+        added = true;
+      } else if (n->nodemap & bit) {
+        n = edit(std::move(n), in_place);
+        auto& child = n->children[index(n->nodemap, bit)];
+        child = update_in(std::move(child), shift + bits, hash, key, f, added,
+                          in_place);
+      } else {
+        n = edit(std::move(n), in_place);
+        n->entries.insert(n->entries.begin() + index(n->datamap, bit),
+                          entry(key, f(static_cast<V*>(nullptr))));
+        n->datamap |= bit;
+        added = true;
+      }
+      return n;
+    }
+
+    // Removes key, which must be present.
+    static node_ptr erase_in(node_ptr n,
+                             unsigned shift,
+                             std::size_t hash,
+                             K const& key,
+                             bool in_place) {
+      n = edit(std::move(n), in_place);
+      if (shift >= hash_bits) {
+        for (auto i = n->entries.begin(); i != n->entries.end(); ++i) {
+          if (Equal{}(i->first, key)) {
+            n->entries.erase(i);
+            break;
+          }
+        }
+        return n;
+      }
+      auto bit = bit_for(hash, shift);
+      if (n->datamap & bit) {
+        n->entries.erase(n->entries.begin() + index(n->datamap, bit));
+        n->datamap ^= bit;
+        return n;
+      }
+      auto i = index(n->nodemap, bit);
+      auto child =
+          erase_in(std::move(n->children[i]), shift + bits, hash, key, in_place);
+      if (child->children.empty() && child->entries.size() == 1) {
+        // Keep the trie canonical by pulling a lone entry up into its parent.
+        n->children.erase(n->children.begin() + i);
+        n->nodemap ^= bit;
+        n->entries.insert(n->entries.begin() + index(n->datamap, bit),
+                          std::move(child->entries.front()));
+        n->datamap |= bit;
+      } else {
+        n->children[i] = std::move(child);
+      }
+      return n;
+    }
+
+    template <typename F>
+    static void for_each_in(node const& n, F& f) {
+      for (auto& e : n.entries) f(e.first, e.second);
+      for (auto& c : n.children) for_each_in(*c, f);
+    }
+
+    template <typename F>
+    map update_impl(K const& key, F& f, bool in_place) && {
+      bool added = false;
+      root = update_in(std::move(root), 0, hash_of(key), key, f, added,
+                       in_place);
+      if (added) ++count;
+      return std::move(*this);
+    }
+
+    map erase_impl(K const& key, bool in_place) && {
+      if (!find(key)) return std::move(*this);
+      root = erase_in(std::move(root), 0, hash_of(key), key, in_place);
+      --count;
+      return std::move(*this);
+    }
+
+   public:
+    using key_type = K;
+    using mapped_type = V;
+
+    class transient;
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Returns a pointer to the value for key, or null if there is none. The
+    // pointer remains valid for as long as this map, or any map that shares
+    // the entry with it, exists.
+    V const* find(K const& key) const {
+      return find_in(root.get(), 0, hash_of(key), key);
+    }
+
+    bool contains(K const& key) const { return find(key) != nullptr; }
+
+    V const& at(K const& key) const {
+      if (auto v = find(key)) return *v;
+      TOBY_THROW(std::out_of_range("persistent::map::at"));
+    }
+
+    // Returns a map with key set to f applied to a pointer to its current
+    // value, which is null if there is none.
+    template <typename F>
+    map update(K const& key, F f) const& {
+      return map(*this).update_impl(key, f, false);
+    }
+    template <typename F>
+    map update(K const& key, F f) && {
+      return std::move(*this).update_impl(key, f, true);
+    }
+
+    map set(K const& key, V value) const& {
+      return update(key, [&](V const*) { return std::move(value); });
+    }
+    map set(K const& key, V value) && {
+      return std::move(*this).update(
+          key, [&](V const*) { return std::move(value); });
+    }
+
+    map erase(K const& key) const& { return map(*this).erase_impl(key, false); }
+    map erase(K const& key) && { return std::move(*this).erase_impl(key, true); }
+
+    // Calls f(key, value) for each entry, in no particular order.
+    template <typename F>
+    void for_each(F&& f) const {
+      for_each_in(*root, f);
+    }
+
+    transient make_transient() const& { return transient(*this); }
+    transient make_transient() && { return transient(std::move(*this)); }
+  };
+
+  // A mutable view of a persistent map for batches of updates, as for
+  // vector<T>::transient.
+  template <typename K, typename V, typename Hash, typename Equal>
+  class map<K, V, Hash, Equal>::transient {
+    map m;
+
+   public:
+    explicit transient(map m) : m(std::move(m)) {}
+
+    std::size_t size() const { return m.size(); }
+    V const* find(K const& key) const { return m.find(key); }
+
+    void set(K const& key, V value) {
+      m = std::move(m).set(key, std::move(value));
+    }
+    template <typename F>
+    void update(K const& key, F f) {
+      m = std::move(m).update(key, std::move(f));
+    }
+    void erase(K const& key) { m = std::move(m).erase(key); }
+
+    map persistent() && { return std::move(m); }
+  };
+}  // namespace toby::persistent
+
+// State helpers for computations whose state is a persistent container. Each
+// one updates the container it is run on in place where it is not shared with
+// a snapshot, since the state is moved through a State computation.
+namespace toby::state {
+  // The value at key, if there is one.
+  template <typename K>
+  constexpr auto get_at(K key) {
+    return gets([key = std::move(key)](auto const& m) {
+      using V = std::remove_cvref_t<decltype(*m.find(key))>;
+      auto v = m.find(key);
+      return v ? std::optional<V>(*v) : std::nullopt;
+    });
+  }
+
+  template <typename K, typename V>
+  constexpr auto put_at(K key, V value) {
+    return modify([key = std::move(key), value = std::move(value)](auto&& m) {
+      return std::forward<decltype(m)>(m).set(key, value);
+    });
+  }
+
+  template <typename K, typename F>
+  constexpr auto update_at(K key, F f) {
+    return modify([key = std::move(key), f = std::move(f)](auto&& m) {
+      return std::forward<decltype(m)>(m).update(key, f);
+    });
+  }
+
+  template <typename K>
+  constexpr auto erase_at(K key) {
+    return modify([key = std::move(key)](auto&& m) {
+      return std::forward<decltype(m)>(m).erase(key);
+    });
+  }
+
+  template <typename T>
+  constexpr auto push_back(T x) {
+    return modify([x = std::move(x)](auto&& m) {
+      return std::forward<decltype(m)>(m).push_back(x);
+    });
+  }
+}  // namespace toby::state
+
+#endif  // PERSISTENT_H
@@ -0,0 +1,341 @@
+#ifndef RESULT_H
+#define RESULT_H
+
+#include "compiler.h"
+#include "monad_promise.h"
+
+#include <experimental/functor.hpp>
+#include <experimental/make.hpp>
+#include <experimental/monad.hpp>
+
+#include <experimental/coroutine>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/*!
+= Result
+
+`result<T, E>` holds either a value of type `T` or an error of type `E`, like
+`expected<T, E>`, and works with `monad_promise` and the std-make customization
+points in the same way. The difference is that it is no more than a union and a
+flag: when `T` and `E` are trivially copyable, so is `result<T, E>`, which means
+that a small one is returned in registers rather than through memory.
+*/
+
+namespace toby {
+  // The error of a failed result, for constructing one.
+  template <typename E>
+  struct failure {
+    E error;
+  };
+
+  template <typename E>
+  constexpr auto fail(E&& e) {
+    return failure<std::decay_t<E>>{std::forward<E>(e)};
+  }
+
+  template <typename T>
+  struct is_failure : std::false_type {};
+  template <typename E>
+  struct is_failure<failure<E>> : std::true_type {};
+
+  // The storage of a result, with special members that are all trivial when
+  // those of T and E are.
+  template <typename T,
+            typename E,
+            bool = std::is_trivially_copyable_v<T> &&
+                   std::is_trivially_copyable_v<E>>
+  struct result_storage {
+    union {
+      T value_;
+      E error_;
+    };
+    bool has_value_;
+
+    template <typename... Args>
+    constexpr result_storage(std::in_place_index_t<0>, Args&&... args)
+        : value_(std::forward<Args>(args)...), has_value_(true) {}
+    template <typename... Args>
+    constexpr result_storage(std::in_place_index_t<1>, Args&&... args)
+        : error_(std::forward<Args>(args)...), has_value_(false) {}
+  };
+
+  template <typename T, typename E>
+  struct result_storage<T, E, false> {
+    union {
+      T value_;
+      E error_;
+    };
+    bool has_value_;
+
+    template <typename... Args>
+    result_storage(std::in_place_index_t<0>, Args&&... args)
+        : value_(std::forward<Args>(args)...), has_value_(true) {}
+    template <typename... Args>
+    result_storage(std::in_place_index_t<1>, Args&&... args)
+        : error_(std::forward<Args>(args)...), has_value_(false) {}
+
+    result_storage(result_storage const& other)
+        : has_value_(other.has_value_) {
+      if (has_value_) {
+        ::new (&value_) T(other.value_);
+      } else {
+        ::new (&error_) E(other.error_);
+      }
+    }
+    result_storage(result_storage&& other) noexcept(
+        std::is_nothrow_move_constructible_v<T>&&
+            std::is_nothrow_move_constructible_v<E>)
+        : has_value_(other.has_value_) {
+      if (has_value_) {
+        ::new (&value_) T(std::move(other.value_));
+      } else {
+        ::new (&error_) E(std::move(other.error_));
+      }
+    }
+
+    // Assignment between two values or two errors assigns, and otherwise
+    // switches alternatives with reinit, so that a copy or move that throws
+    // leaves the result holding what it held before.
+    result_storage& operator=(result_storage const& other) {
+      if (has_value_ && other.has_value_) {
+        value_ = other.value_;
+      } else if (has_value_) {
+        reinit(error_, value_, other.error_);
+      } else if (other.has_value_) {
+        reinit(value_, error_, other.value_);
+      } else {
+        error_ = other.error_;
+      }
+      return *this;
+    }
+    result_storage& operator=(result_storage&& other) noexcept(
+        std::is_nothrow_move_constructible_v<T>&&
+            std::is_nothrow_move_constructible_v<E>&&
+                std::is_nothrow_move_assignable_v<T>&&
+                    std::is_nothrow_move_assignable_v<E>) {
+      if (has_value_ && other.has_value_) {
+        value_ = std::move(other.value_);
+      } else if (has_value_) {
+        reinit(error_, value_, std::move(other.error_));
+      } else if (other.has_value_) {
+        reinit(value_, error_, std::move(other.value_));
+      } else {
+        error_ = std::move(other.error_);
+      }
+      return *this;
+    }
+
+    ~result_storage() { destroy(); }
+
+    void destroy() {
+      if (has_value_) {
+        value_.~T();
+      } else {
+        error_.~E();
+      }
+    }
+
+   private:
+    // Replaces the alternative held in current with one in next constructed
+    // from args. The old alternative is only destroyed once the new one can no
+    // longer fail to be constructed, or is moved aside and put back if it does.
+    template <typename Next, typename Current, typename... Args>
+    void reinit(Next& next, Current& current, Args&&... args) {
+      if constexpr (std::is_nothrow_constructible_v<Next, Args...>) {
+        current.~Current();
+        ::new (&next) Next(std::forward<Args>(args)...);
+      } else if constexpr (std::is_nothrow_move_constructible_v<Next>) {
+        Next tmp(std::forward<Args>(args)...);
+        current.~Current();
+        ::new (&next) Next(std::move(tmp));
+      } else {
+        static_assert(std::is_nothrow_move_constructible_v<Current>,
+                      "result assignment requires T or E to be nothrow move "
+                      "constructible");
+        Current backup(std::move(current));
+        current.~Current();
+#if TOBY_EXCEPTIONS
+        try {
+          ::new (&next) Next(std::forward<Args>(args)...);
+        } catch (...) {
+          ::new (&current) Current(std::move(backup));
+          throw;
+        }
+#else
+        ::new (&next) Next(std::forward<Args>(args)...);
+#endif
+      }
+      has_value_ = !has_value_;
+    }
+  };
+
+  template <typename T, typename E>
+  class result : result_storage<T, E> {
+    using storage = result_storage<T, E>;
+
+   public:
+    using value_type = T;
+    using error_type = E;
+
+    template <typename U = T,
+              typename = std::enable_if_t<
+                  std::is_constructible_v<T, U&&> &&
+                  !std::is_same_v<std::remove_cvref_t<U>, result> &&
+                  !is_failure<std::remove_cvref_t<U>>::value>>
+    constexpr result(U&& x)
+        : storage(std::in_place_index<0>, std::forward<U>(x)) {}
+
+    template <typename G>
+    constexpr result(failure<G> const& f)
+        : storage(std::in_place_index<1>, f.error) {}
+    template <typename G>
+    constexpr result(failure<G>&& f)
+        : storage(std::in_place_index<1>, std::move(f.error)) {}
+
+    constexpr bool has_value() const { return this->has_value_; }
+    constexpr explicit operator bool() const { return this->has_value_; }
+
+    // Unchecked access.
+    constexpr T& operator*() & { return this->value_; }
+    constexpr T const& operator*() const& { return this->value_; }
+    constexpr T&& operator*() && { return std::move(this->value_); }
+    constexpr T* operator->() { return &this->value_; }
+    constexpr T const* operator->() const { return &this->value_; }
+
+    constexpr E& error() & { return this->error_; }
+    constexpr E const& error() const& { return this->error_; }
+    constexpr E&& error() && { return std::move(this->error_); }
+
+    // Checked access.
+    constexpr T& value() & { return check(), this->value_; }
+    constexpr T const& value() const& { return check(), this->value_; }
+    constexpr T&& value() && { return check(), std::move(this->value_); }
+
+    // The return types are deduced, rather than declared, so that they are
+    // only computed for the overload that is called: a continuation created by
+    // monad_promise can only be invoked with an rvalue.
+    template <typename F>
+    constexpr auto bind(F&& f) && {
+      using R = std::invoke_result_t<F, T&&>;
+      if (TOBY_LIKELY(has_value())) {
+        return R(std::forward<F>(f)(std::move(this->value_)));
+      }
+      return propagate<R>(std::move(this->error_));
+    }
+    template <typename F>
+    constexpr auto bind(F&& f) const& {
+      using R = std::invoke_result_t<F, T const&>;
+      if (TOBY_LIKELY(has_value())) {
+        return R(std::forward<F>(f)(this->value_));
+      }
+      return propagate<R>(this->error_);
+    }
+
+    template <typename F>
+    constexpr auto map(F&& f) && {
+      using R = result<std::invoke_result_t<F, T&&>, E>;
+      if (TOBY_LIKELY(has_value())) {
+        return R(std::forward<F>(f)(std::move(this->value_)));
+      }
+      return propagate<R>(std::move(this->error_));
+    }
+    template <typename F>
+    constexpr auto map(F&& f) const& {
+      using R = result<std::invoke_result_t<F, T const&>, E>;
+      if (TOBY_LIKELY(has_value())) {
+        return R(std::forward<F>(f)(this->value_));
+      }
+      return propagate<R>(this->error_);
+    }
+
+   private:
+    constexpr void check() const {
+      if (TOBY_UNLIKELY(!has_value())) throw_bad_access();
+    }
+
+    [[noreturn]] TOBY_COLD TOBY_NOINLINE static void throw_bad_access() {
+      TOBY_THROW(std::logic_error("result has no value"));
+    }
+
+    // Passing an error on is the path that is rarely taken, so it is kept out
+    // of line, leaving the code for the path that carries on with a value
+    // contiguous.
+    template <typename R, typename G>
+    TOBY_COLD TOBY_NOINLINE static R propagate(G&& e) {
+      return R(failure<E>{std::forward<G>(e)});
+    }
+  };
+
+  template <typename E>
+  struct ResultTC {
+    template <typename... T>
+    using invoke = result<T..., E>;
+
+    template <typename... T>
+    using t = invoke<T...>;
+  };
+}  // namespace toby
+
+namespace std::experimental {
+  template <typename T, typename E>
+  struct type_constructor<toby::result<T, E>> : meta::id<toby::ResultTC<E>> {};
+
+  namespace type_constructible {
+    template <typename T, typename E>
+    struct traits<toby::result<T, E>> {
+      template <typename M, typename X>
+      static constexpr auto make(X&& x) {
+        return toby::result<std::remove_cvref_t<X>, E>(std::forward<X>(x));
+      }
+    };
+  }  // namespace type_constructible
+
+  namespace functor {
+    template <typename E>
+    struct traits<toby::ResultTC<E>> : mcd_transform {
+      template <typename M, typename F>
+      static constexpr auto transform(M&& x, F&& f) {
+        return std::forward<M>(x).map(std::forward<F>(f));
+      }
+    };
+  }  // namespace functor
+
+  namespace monad {
+    template <typename E>
+    struct traits<toby::ResultTC<E>> : mcd_bind {
+      template <typename M, typename F>
+      static constexpr auto bind(M&& x, F&& f) {
+        return std::forward<M>(x).bind(std::forward<F>(f));
+      }
+    };
+  }  // namespace monad
+
+  // This makes result<T, E> useable as a coroutine return type.
+  template <typename T, typename E, typename... Args>
+  struct coroutine_traits<toby::result<T, E>, Args...> {
+    using promise_type = monad_promise<toby::result<T, E>>;
+  };
+}  // namespace std::experimental
+
+// result's bind passes its continuation a reference to its value when called on
+// an lvalue, so co_await on an lvalue result yields a reference.
+template <typename T, typename E>
+struct yields_reference<toby::result<T, E>> : std::true_type {};
+
+// A coroutine returning a result whose error type is std::exception_ptr returns
+// any exception that escapes its body as the error.
+template <typename T>
+struct exception_traits<toby::result<T, std::exception_ptr>> {
+  static constexpr exception_policy policy = exception_policy::convert;
+
+  static toby::result<T, std::exception_ptr> from_exception(
+      std::exception_ptr e) {
+    return toby::fail(std::move(e));
+  }
+};
+
+#endif  // RESULT_H
@@ -1,11 +1,11 @@
 #ifndef RETURN_OBJECT_HOLDER_H
 #define RETURN_OBJECT_HOLDER_H
 
+#include "compiler.h"
+
 #include <optional>
 #include <utility>
 
-#include <iostream>
-
 // An object that starts out unitialized. Initialized by a call to emplace.
 template <typename T>
 using deferred = std::optional<T>;
@@ -34,25 +34,23 @@ struct return_object_holder {
 
   // A non-trivial destructor is required until
   // https://bugs.llvm.org//show_bug.cgi?id=28593 is fixed.
-  ~return_object_holder() { std::cout << this << ": ~return_object_holder" << std::endl; }
+  ~return_object_holder() {}
 
   // Construct the staging value; arguments are perfect forwarded to T's constructor.
   template <typename... Args>
-  void emplace(Args&&... args) {
-    std::cout << this << ": emplace" << std::endl;
+  TOBY_FORWARDER void emplace(Args&&... args) {
     stage.emplace(std::forward<Args>(args)...);
   }
 
   // We assume that we will be converted only once, so we can move from the staging
   // object. We also assume that `emplace` has been called at least once.
-  operator T() {
-    std::cout << this << ": operator T" << std::endl;
+  TOBY_FORWARDER operator T() {
     return std::move(*stage);
   }
 };
 
 template <typename T>
-auto make_return_object_holder(return_object_holder<T>*& p) {
+TOBY_FORWARDER auto make_return_object_holder(return_object_holder<T>*& p) {
   return return_object_holder<T>{p};
 }
 
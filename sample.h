@@ -0,0 +1,254 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "compiler.h"
+#include "function_tc.h"
+#include "state.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*!
+= Sampling
+
+A sampling computation, such as one step of a Monte Carlo simulation, is a
+State computation whose state is a random number generator. Since it runs each
+of its continuations at most once, it can be written as a coroutine:
+
+~~~cpp
+auto in_unit_circle() -> toby::sample::sample<bool> {
+  auto x = co_await toby::sample::uniform;
+  auto y = co_await toby::sample::uniform;
+  co_return x * x + y * y <= 1.0;
+}
+~~~
+
+The generator is counter-based (Philox4x32-10): its state is a key, a stream
+number and a position in the stream, and each number drawn is a pure function
+of those. This makes it cheap to give every sample its own independent stream,
+so that `run_parallel` produces the same results whichever thread runs which
+sample, and however many threads there are.
+*/
+
+namespace toby::sample {
+  // The Philox4x32-10 block function of Salmon et al., "Parallel Random
+  // Numbers: As Easy as 1, 2, 3" (SC11).
+  constexpr std::array<std::uint32_t, 4> philox4x32_10(
+      std::array<std::uint32_t, 4> ctr, std::array<std::uint32_t, 2> key) {
+    for (int round = 0; round < 10; ++round) {
+      if (round) {
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+      }
+      auto p0 = std::uint64_t(0xD2511F53u) * ctr[0];
+      auto p1 = std::uint64_t(0xCD9E8D57u) * ctr[2];
+      ctr = {std::uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], std::uint32_t(p1),
+             std::uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], std::uint32_t(p0)};
+    }
+    return ctr;
+  }
+
+  struct rng {
+    std::uint64_t key;
+    std::uint64_t stream;
+    std::uint64_t position;
+
+    // The generator for sample number `index` of a run seeded with `seed`.
+    static constexpr rng for_sample(std::uint64_t seed, std::uint64_t index) {
+      return rng{seed, index, 0};
+    }
+
+    // Draws the next 64 random bits, advancing the position.
+    constexpr std::uint64_t next() {
+      auto r = philox4x32_10(
+          {std::uint32_t(position), std::uint32_t(position >> 32),
+           std::uint32_t(stream), std::uint32_t(stream >> 32)},
+          {std::uint32_t(key), std::uint32_t(key >> 32)});
+      ++position;
+      return std::uint64_t(r[0]) | std::uint64_t(r[1]) << 32;
+    }
+
+    friend constexpr bool operator==(rng const& lhs, rng const& rhs) {
+      return lhs.key == rhs.key && lhs.stream == rhs.stream &&
+             lhs.position == rhs.position;
+    }
+  };
+
+  // The type-erased sampling monad, for use as a coroutine return type.
+  using SampleTC = toby::state::StateTC<OneShotFunctionTC, rng>;
+
+  template <typename A>
+  using sample = SampleTC::t<A>;
+
+  // The distributions below are not type-erased; like the State primitives,
+  // they can be co_awaited in a sample coroutine or composed with >>=.
+
+  // A sample from f(bits), where bits are 64 uniformly random bits.
+  template <typename F>
+  constexpr auto from_bits(F f) {
+    return toby::state::RawState{[f](rng s) {
+      auto x = f(s.next());
+      return toby::state::RunResult{x, s};
+    }};
+  }
+
+  constexpr double to_unit_interval(std::uint64_t bits) {
+    return double(bits >> 11) * 0x1.0p-53;
+  }
+
+  // Uniform on [0, 1).
+  constexpr inline auto uniform = from_bits(to_unit_interval);
+
+  // Uniform on [a, b).
+  constexpr auto uniform_real(double a, double b) {
+    return from_bits([=](std::uint64_t bits) {
+      return a + (b - a) * to_unit_interval(bits);
+    });
+  }
+
+  // The high and low halves of the 128-bit product of x and y.
+  constexpr std::pair<std::uint64_t, std::uint64_t> mul_wide(std::uint64_t x,
+                                                             std::uint64_t y) {
+    auto lo_lo = (x & 0xFFFFFFFFu) * (y & 0xFFFFFFFFu);
+    auto hi_lo = (x >> 32) * (y & 0xFFFFFFFFu);
+    auto lo_hi = (x & 0xFFFFFFFFu) * (y >> 32);
+    auto hi_hi = (x >> 32) * (y >> 32);
+    auto cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+    return {hi_hi + (hi_lo >> 32) + (cross >> 32),
+            (cross << 32) | (lo_lo & 0xFFFFFFFFu)};
+  }
+
+  // Uniform on the integers [lo, hi], without bias (Lemire's method).
+  constexpr auto uniform_int(std::int64_t lo, std::int64_t hi) {
+    return toby::state::RawState{[=](rng s) {
+      auto range = std::uint64_t(hi) - std::uint64_t(lo) + 1;
+      if (range == 0) {
+        // lo and hi span the whole of int64_t.
+        auto x = std::int64_t(s.next());
+        return toby::state::RunResult{x, s};
+      }
+      auto threshold = (0 - range) % range;
+      for (;;) {
+        auto [hi_bits, lo_bits] = mul_wide(s.next(), range);
+        if (lo_bits >= threshold) {
+          auto x = std::int64_t(std::uint64_t(lo) + hi_bits);
+          return toby::state::RunResult{x, s};
+        }
+      }
+    }};
+  }
+
+  constexpr auto bernoulli(double p) {
+    return from_bits(
+        [=](std::uint64_t bits) { return to_unit_interval(bits) < p; });
+  }
+
+  // Normally distributed, by the Box-Muller transform.
+  inline auto normal(double mean = 0.0, double stddev = 1.0) {
+    return toby::state::RawState{[=](rng s) {
+      auto u1 = 1.0 - to_unit_interval(s.next());
+      auto u2 = to_unit_interval(s.next());
+      auto x = mean + stddev * std::sqrt(-2.0 * std::log(u1)) *
+                          std::cos(6.283185307179586 * u2);
+      return toby::state::RunResult{x, s};
+    }};
+  }
+
+  // Runs n samples of m, each with the generator rng::for_sample(seed, i), and
+  // reduces their results: reduce(T, A) accumulates a result into a partial
+  // result and combine(T, T) joins two partial results. m may be a RawState,
+  // or a function returning the sample to run (a sample coroutine, say, whose
+  // result can only be run once).
+  //
+  // Samples are reduced in fixed-size blocks, in order, and the blocks are then
+  // combined in order, so the result does not depend on the number of threads
+  // even when reduce and combine are not associative, as floating-point
+  // addition is not. threads == 0 means one per hardware thread.
+  //
+  // Every block starts from a copy of init, so init must be an identity of
+  // reduce and combine, as zero is of a sum; with n == 0 it is the result. An
+  // exception thrown by m, reduce or combine stops the samples not yet begun
+  // and is rethrown once every thread has finished.
+  template <typename M, typename T, typename Reduce, typename Combine>
+  T run_parallel(M const& m,
+                 std::size_t n,
+                 std::uint64_t seed,
+                 T init,
+                 Reduce reduce,
+                 Combine combine,
+                 unsigned threads = 0) {
+    constexpr std::size_t block_size = 1024;
+    auto blocks = (n + block_size - 1) / block_size;
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<std::size_t>(threads, blocks));
+
+    std::vector<T> partials(blocks, init);
+    std::atomic<std::size_t> next_block{0};
+    auto run_blocks = [&] {
+      for (std::size_t b; (b = next_block.fetch_add(1)) < blocks;) {
+        auto acc = init;
+        auto end = std::min(n, (b + 1) * block_size);
+        for (auto i = b * block_size; i < end; ++i) {
+          auto r = rng::for_sample(seed, i);
+          if constexpr (std::is_invocable_v<M const&>) {
+            acc = reduce(std::move(acc), m().run(r).data);
+          } else {
+            acc = reduce(std::move(acc), m.run(r).data);
+          }
+        }
+        partials[b] = std::move(acc);
+      }
+    };
+
+    std::vector<std::thread> pool;
+    auto join_all = [&] {
+      for (auto& t : pool) t.join();
+    };
+#if TOBY_EXCEPTIONS
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&] {
+      try {
+        run_blocks();
+      } catch (...) {
+        next_block = blocks;
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+      }
+    };
+    try {
+      for (unsigned t = 1; t < threads; ++t) pool.emplace_back(work);
+    } catch (...) {
+      next_block = blocks;
+      join_all();
+      throw;
+    }
+    work();
+    join_all();
+    if (error) std::rethrow_exception(error);
+#else
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(run_blocks);
+    run_blocks();
+    join_all();
+#endif
+
+    if (partials.empty()) return init;
+    auto result = std::move(partials.front());
+    for (std::size_t b = 1; b < blocks; ++b) {
+      result = combine(std::move(result), std::move(partials[b]));
+    }
+    return result;
+  }
+}  // namespace toby::sample
+
+#endif  // SAMPLE_H
@@ -1,9 +1,15 @@
 #ifndef STATE_H
 #define STATE_H
 
+#include "compiler.h"
+#include "lens.h"
 #include "monad_promise.h"
 
-#include <functional>
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 /*!
 = The State Monad
@@ -38,8 +44,22 @@ get = State $ \s -> (s, s)
 
 put :: a -> State a ()
 put x = State $ \_ -> ((), x)
+
+modify :: (s -> s) -> State s ()
+modify f = State $ \s -> ((), f s)
+
+gets :: (s -> a) -> State s a
+gets f = State $ \s -> (f s, s)
 ~~~
 
+`modify` and `gets` are more than conveniences here: they let a computation
+update or read part of a large state without copying the whole of it out with
+`get` and back in with `put`.
+
+The non-type-erased forms of all of these are constexpr, so a program built
+from them can be run in a constant expression, for example to generate a lookup
+table at compile time with `replicate`.
+
 */
 
 #define FWD(x) std::forward<decltype(x)>(x)
@@ -61,9 +81,14 @@ namespace toby::state {
     F run;
 
     // operator version of non-type-erased bind
-    template <typename M, typename FF>
-    friend constexpr auto operator>>=(M&& m, FF&& f) {
-      return bind(std::forward<M>(m), std::forward<FF>(f));
+    template <typename FF>
+    friend TOBY_FORWARDER constexpr auto operator>>=(RawState const& m,
+                                                     FF&& f) {
+      return bind(m, std::forward<FF>(f));
+    }
+    template <typename FF>
+    friend TOBY_FORWARDER constexpr auto operator>>=(RawState&& m, FF&& f) {
+      return bind(std::move(m), std::forward<FF>(f));
     }
   };
 
@@ -72,12 +97,27 @@ namespace toby::state {
   RawState(F) -> RawState<F>;
   // clang-format on
 
+  // The function run by pure. When run as an rvalue, the value is moved out
+  // rather than copied, so that it may be move-only.
+  template <typename A>
+  struct purer {
+    A x;
+
+    template <typename S>
+    TOBY_FORWARDER constexpr auto operator()(S&& s) const& {
+      return RunResult<A, std::remove_cvref_t<S>>{x, std::forward<S>(s)};
+    }
+    template <typename S>
+    TOBY_FORWARDER constexpr auto operator()(S&& s) && {
+      return RunResult<A, std::remove_cvref_t<S>>{std::move(x),
+                                                  std::forward<S>(s)};
+    }
+  };
+
   // Non-type-erased pure
   template <typename A>
-  constexpr auto pure(A&& x) {
-    return RawState{[x = std::forward<A>(x)](auto&& s) {
-      return RunResult{x, FWD(s)};
-    }};
+  TOBY_FORWARDER constexpr auto pure(A&& x) {
+    return RawState{purer<std::decay_t<A>>{std::forward<A>(x)}};
   }
 
   // Non-type-erased transform
@@ -87,12 +127,12 @@ namespace toby::state {
     F f;
 
     template <typename S>
-    constexpr auto operator()(S&& s) && {
+    TOBY_FORWARDER constexpr auto operator()(S&& s) && {
       auto ret = std::move(x).run(std::forward<S>(s));
       return RunResult{std::move(f)(std::move(ret.data)), std::move(ret.state)};
     }
     template <typename S>
-    constexpr auto operator()(S&& s) const& {
+    TOBY_FORWARDER constexpr auto operator()(S&& s) const& {
       auto ret = x.run(std::forward<S>(s));
       return RunResult{f(std::move(ret.data)), std::move(ret.state)};
     }
@@ -101,7 +141,7 @@ namespace toby::state {
   transformer(M, F)->transformer<M, F>;
 
   template <typename M, typename F>
-  constexpr auto transform(M&& x, F&& f) {
+  TOBY_FORWARDER constexpr auto transform(M&& x, F&& f) {
     return RawState{transformer{std::forward<M>(x), std::forward<F>(f)}};
   }
 
@@ -112,12 +152,12 @@ namespace toby::state {
     F f;
 
     template <typename S>
-    constexpr auto operator()(S&& s) && {
+    TOBY_FORWARDER constexpr auto operator()(S&& s) && {
       auto ret = std::move(x).run(std::forward<S>(s));
       return std::move(f)(std::move(ret.data)).run(std::move(ret.state));
     }
     template <typename S>
-    constexpr auto operator()(S&& s) const& {
+    TOBY_FORWARDER constexpr auto operator()(S&& s) const& {
       auto ret = x.run(std::forward<S>(s));
       return f(std::move(ret.data)).run(std::move(ret.state));
     }
@@ -126,7 +166,7 @@ namespace toby::state {
   binder(M, F)->binder<M, F>;
 
   template <typename M, typename F>
-  constexpr auto bind(M&& x, F&& f) {
+  TOBY_FORWARDER constexpr auto bind(M&& x, F&& f) {
     return RawState{binder{std::forward<M>(x), std::forward<F>(f)}};
   }
 
@@ -136,13 +176,124 @@ namespace toby::state {
     return RunResult{s, FWD(s)};
   }};
 
+  // get for a known state type, so that it can be run with a braced
+  // initializer.
   template <typename S>
-  constexpr auto put(S&& s) {
-    return RawState{[s = std::forward<S>(s)](auto&&) {
-      return RunResult{unit{}, s};
+  struct getter {
+    TOBY_FORWARDER constexpr auto operator()(S s) const {
+      return RunResult<S, S>{s, std::move(s)};
+    }
+  };
+
+  // The function run by put. When run as an rvalue, the new state is moved out
+  // rather than copied.
+  template <typename S>
+  struct putter {
+    S s;
+
+    TOBY_FORWARDER constexpr auto operator()(S const&) const& {
+      return RunResult<unit, S>{unit{}, s};
+    }
+    TOBY_FORWARDER constexpr auto operator()(S const&) && {
+      return RunResult<unit, S>{unit{}, std::move(s)};
+    }
+  };
+
+  template <typename S>
+  TOBY_FORWARDER constexpr auto put(S&& s) {
+    return RawState{putter<std::remove_cvref_t<S>>{std::forward<S>(s)}};
+  }
+
+  template <typename F>
+  TOBY_FORWARDER constexpr auto modify(F&& f) {
+    return RawState{[f = std::forward<F>(f)](auto&& s) {
+      return RunResult{unit{}, f(FWD(s))};
+    }};
+  }
+
+  // Applies a projection, which may be a function or a pointer to a member, to
+  // x. This is std::invoke with one argument, which is not constexpr until
+  // C++20.
+  template <typename P, typename T>
+  constexpr decltype(auto) project(P const& p, T const& x) {
+    if constexpr (std::is_member_function_pointer_v<P>) {
+      return (x.*p)();
+    } else if constexpr (std::is_member_object_pointer_v<P>) {
+      return x.*p;
+    } else {
+      return p(x);
+    }
+  }
+
+  // The projection may be a function or a pointer to a member, as for
+  // std::invoke.
+  template <typename P>
+  TOBY_FORWARDER constexpr auto gets(P&& projection) {
+    return RawState{[p = std::forward<P>(projection)](auto&& s) {
+      return RunResult{project(p, s), FWD(s)};
     }};
   }
 
+  // Runs m N times in sequence, collecting the results in an array. Since
+  // RawState programs can be run in constant expressions, this can be used to
+  // generate a lookup table at compile time.
+  template <std::size_t N, typename M>
+  struct replicator {
+    M m;
+
+    template <typename S>
+    constexpr auto operator()(S s) const {
+      using A = std::remove_cvref_t<decltype(m.run(std::move(s)).data)>;
+      std::array<A, N> data{};
+      for (auto& x : data) {
+        auto ret = m.run(std::move(s));
+        x = std::move(ret.data);
+        s = std::move(ret.state);
+      }
+      return RunResult{std::move(data), std::move(s)};
+    }
+  };
+
+  template <std::size_t N, typename M>
+  TOBY_FORWARDER constexpr auto replicate(M&& m) {
+    return RawState{replicator<N, std::remove_cvref_t<M>>{std::forward<M>(m)}};
+  }
+
+  // Non-type-erased zoom: runs m, a computation over part of the state, on the
+  // part that the lens l focuses on (see lens.h). Only that part is moved out
+  // of the state and back in again; the rest of the state stays where it is.
+  template <typename L, typename M>
+  struct zoomer {
+    L l;
+    M m;
+
+    template <typename S>
+    constexpr auto operator()(S s) && {
+      auto data = with_focus(l, s, [&](auto& part) {
+        auto ret = std::move(m).run(std::move(part));
+        part = std::move(ret.state);
+        return std::move(ret.data);
+      });
+      return RunResult{std::move(data), std::move(s)};
+    }
+    template <typename S>
+    constexpr auto operator()(S s) const& {
+      auto data = with_focus(l, s, [&](auto& part) {
+        auto ret = m.run(std::move(part));
+        part = std::move(ret.state);
+        return std::move(ret.data);
+      });
+      return RunResult{std::move(data), std::move(s)};
+    }
+  };
+  template <typename L, typename M>
+  zoomer(L, M)->zoomer<L, M>;
+
+  template <typename L, typename M>
+  TOBY_FORWARDER constexpr auto zoom(L&& l, M&& m) {
+    return RawState{zoomer{std::forward<L>(l), std::forward<M>(m)}};
+  }
+
   // Type-erased version that can fit into the type-constructor system.
 
   template <typename FTC, typename S, typename A>
@@ -167,15 +318,29 @@ namespace toby::state {
     using t = invoke<A...>;
 
     template <typename A>
-    static auto pure(A&& x) -> t<std::remove_cvref_t<A>> {
+    TOBY_FORWARDER static auto pure(A&& x) -> t<std::remove_cvref_t<A>> {
       return toby::state::pure(std::forward<A>(x));
     }
 
-    static inline t<S> const get = toby::state::get;
+    // The primitives below are not type-erased, so they are constant
+    // expressions that never allocate; they are converted to t<...> only where
+    // one is required.
+
+    static constexpr RawState<getter<S>> get{};
 
     template <typename SS>
-    static auto put(SS&& s) -> t<unit> {
-      return toby::state::put(std::forward<SS>(s));
+    TOBY_FORWARDER static constexpr auto put(SS&& s) {
+      return RawState{putter<S>{std::forward<SS>(s)}};
+    }
+
+    template <typename F>
+    TOBY_FORWARDER static constexpr auto modify(F&& f) {
+      return toby::state::modify(std::forward<F>(f));
+    }
+
+    template <typename P>
+    TOBY_FORWARDER static constexpr auto gets(P&& projection) {
+      return toby::state::gets(std::forward<P>(projection));
     }
   };
 }  // namespace toby::state
@@ -191,7 +356,7 @@ namespace std::experimental {
     template <typename FTC, typename S, typename A>
     struct traits<toby::state::State<FTC, S, A>> {
       template <typename M, typename X>
-      static auto make(X&& x) {
+      TOBY_FORWARDER static auto make(X&& x) {
         return toby::state::StateTC<FTC, S>::pure(std::forward<X>(x));
       }
     };
@@ -201,7 +366,7 @@ namespace std::experimental {
     template <typename FTC, typename S>
     struct traits<toby::state::StateTC<FTC, S>> : mcd_transform {
       template <typename M, typename F>
-      static auto transform(M&& x, F&& f) -> toby::state::
+      TOBY_FORWARDER static auto transform(M&& x, F&& f) -> toby::state::
           State<FTC, S, invoke_result_t<F, value_type_t<remove_cvref_t<M>>>> {
         return toby::state::transform(std::forward<M>(x), std::forward<F>(f));
       }
@@ -212,7 +377,7 @@ namespace std::experimental {
     template <typename FTC, typename S>
     struct traits<toby::state::StateTC<FTC, S>> : mcd_bind {
       template <typename M, typename F>
-      static auto bind(M&& x, F&& f) -> toby::state::State<
+      TOBY_FORWARDER static auto bind(M&& x, F&& f) -> toby::state::State<
           FTC,
           S,
           value_type_t<invoke_result_t<F, value_type_t<remove_cvref_t<M>>>>> {
@@ -230,4 +395,19 @@ namespace std::experimental {
   };
 }  // namespace std::experimental
 
+// This allows a RawState to be co_awaited in a State coroutine without being
+// type-erased first; only the combined continuation is erased, once, when the
+// result of bind is stored in the coroutine.
+template <typename FTC, typename S, typename A, typename F>
+struct direct_bind_traits<toby::state::State<FTC, S, A>,
+                          toby::state::RawState<F>> {
+  using value_type =
+      std::remove_cvref_t<decltype(std::declval<F>()(std::declval<S>()).data)>;
+
+  template <typename K>
+  TOBY_FORWARDER static auto bind(toby::state::RawState<F>&& x, K&& k) {
+    return toby::state::bind(std::move(x), std::forward<K>(k));
+  }
+};
+
 #endif  // STATE_H
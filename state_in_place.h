@@ -0,0 +1,316 @@
+#ifndef STATE_IN_PLACE_H
+#define STATE_IN_PLACE_H
+
+#include "state.h"
+
+/*!
+= The State Monad, in place
+
+The State monad in `state.h` threads the state through a computation by value:
+every step takes the state and returns it again inside a `RunResult`, and `get`
+returns a copy of all of it. That is faithful to the Haskell definition but, for
+a large state, most of the time goes into moving and copying it.
+
+This variant has the same surface (`pure`, `get`, `put`, `modify`, `gets`,
+`transform`, `bind`, `StateTC` and coroutine support) but a computation is run
+on a reference to a single state object owned by whoever runs it, and returns
+only its result. This is closer in spirit to Haskell's `ST` monad than to
+`State`:
+
+~~~haskell
+newtype State s a = State { run :: STRef s -> ST s a }
+~~~
+
+`get` still has to return a copy of the state, since its result is a value;
+use `gets` to read part of the state and `modify` to update it in place.
+*/
+
+namespace toby::state::in_place {
+  // Declared here so that the operator below does not find toby::state::bind.
+  template <typename M, typename F>
+  constexpr auto bind(M&& x, F&& f);
+
+  template <typename F>
+  struct RawState {
+    F run;
+
+    // operator version of non-type-erased bind
+    template <typename FF>
+    friend constexpr auto operator>>=(RawState const& m, FF&& f) {
+      return bind(m, std::forward<FF>(f));
+    }
+    template <typename FF>
+    friend constexpr auto operator>>=(RawState&& m, FF&& f) {
+      return bind(std::move(m), std::forward<FF>(f));
+    }
+  };
+
+  // clang-format off
+  template <typename F>
+  RawState(F) -> RawState<F>;
+  // clang-format on
+
+  // The function run by pure. When run as an rvalue, the value is moved out
+  // rather than copied.
+  template <typename A>
+  struct purer {
+    A x;
+
+    template <typename S>
+    constexpr A operator()(S&) const& {
+      return x;
+    }
+    template <typename S>
+    constexpr A operator()(S&) && {
+      return std::move(x);
+    }
+  };
+
+  // Non-type-erased pure
+  template <typename A>
+  constexpr auto pure(A&& x) {
+    return RawState{purer<std::decay_t<A>>{std::forward<A>(x)}};
+  }
+
+  // Non-type-erased transform
+  template <typename M, typename F>
+  struct transformer {
+    M x;
+    F f;
+
+    template <typename S>
+    constexpr auto operator()(S& s) && {
+      return std::move(f)(std::move(x).run(s));
+    }
+    template <typename S>
+    constexpr auto operator()(S& s) const& {
+      return f(x.run(s));
+    }
+  };
+  template <typename M, typename F>
+  transformer(M, F)->transformer<M, F>;
+
+  template <typename M, typename F>
+  constexpr auto transform(M&& x, F&& f) {
+    return RawState{transformer{std::forward<M>(x), std::forward<F>(f)}};
+  }
+
+  // Non-type-erased bind
+  template <typename M, typename F>
+  struct binder {
+    M x;
+    F f;
+
+    template <typename S>
+    constexpr auto operator()(S& s) && {
+      return std::move(f)(std::move(x).run(s)).run(s);
+    }
+    template <typename S>
+    constexpr auto operator()(S& s) const& {
+      return f(x.run(s)).run(s);
+    }
+  };
+  template <typename M, typename F>
+  binder(M, F)->binder<M, F>;
+
+  template <typename M, typename F>
+  constexpr auto bind(M&& x, F&& f) {
+    return RawState{binder{std::forward<M>(x), std::forward<F>(f)}};
+  }
+
+  constexpr inline auto get = RawState{[](auto& s) { return s; }};
+
+  // get for a known state type.
+  template <typename S>
+  struct getter {
+    constexpr S operator()(S& s) const { return s; }
+  };
+
+  // The function run by put. When run as an rvalue, the new state is moved in
+  // rather than copied.
+  template <typename S>
+  struct putter {
+    S x;
+
+    constexpr unit operator()(S& s) const& {
+      s = x;
+      return {};
+    }
+    constexpr unit operator()(S& s) && {
+      s = std::move(x);
+      return {};
+    }
+  };
+
+  template <typename S>
+  constexpr auto put(S&& s) {
+    return RawState{putter<std::remove_cvref_t<S>>{std::forward<S>(s)}};
+  }
+
+  // f either updates the state through the reference it is given and returns
+  // nothing, or returns the new state as in state.h.
+  template <typename F>
+  constexpr auto modify(F&& f) {
+    return RawState{[f = std::forward<F>(f)](auto& s) {
+      if constexpr (std::is_void_v<decltype(f(s))>) {
+        f(s);
+      } else {
+        s = f(std::move(s));
+      }
+      return unit{};
+    }};
+  }
+
+  template <typename P>
+  constexpr auto gets(P&& projection) {
+    return RawState{[p = std::forward<P>(projection)](auto& s) {
+      return project(p, s);
+    }};
+  }
+
+  // Non-type-erased zoom: runs m, a computation over part of the state, on the
+  // part that the lens l focuses on (see lens.h), in place.
+  template <typename L, typename M>
+  struct zoomer {
+    L l;
+    M m;
+
+    template <typename S>
+    constexpr auto operator()(S& s) && {
+      return with_focus(l, s,
+                        [&](auto& part) { return std::move(m).run(part); });
+    }
+    template <typename S>
+    constexpr auto operator()(S& s) const& {
+      return with_focus(l, s, [&](auto& part) { return m.run(part); });
+    }
+  };
+  template <typename L, typename M>
+  zoomer(L, M)->zoomer<L, M>;
+
+  template <typename L, typename M>
+  constexpr auto zoom(L&& l, M&& m) {
+    return RawState{zoomer{std::forward<L>(l), std::forward<M>(m)}};
+  }
+
+  // Runs m on a state that it takes ownership of, returning the result along
+  // with the final state.
+  template <typename M, typename S>
+  constexpr auto run(M&& m, S s) {
+    auto data = std::forward<M>(m).run(s);
+    return RunResult<decltype(data), S>{std::move(data), std::move(s)};
+  }
+
+  // Type-erased version that can fit into the type-constructor system.
+
+  template <typename FTC, typename S, typename A>
+  struct State {
+    using value_type = A;
+
+    std::experimental::meta::invoke<FTC, A, S&> run;
+
+    template <typename F>
+    State(RawState<F> rs) : run(std::move(rs.run)) {}
+
+    template <typename OtherFTC>
+    State(State<OtherFTC, S, A> const& other) : run(other.run) {}
+  };
+
+  template <typename FTC, typename S>
+  struct StateTC {
+    template <typename... A>
+    using invoke = State<FTC, S, A...>;
+
+    template <typename... A>
+    using t = invoke<A...>;
+
+    template <typename A>
+    static auto pure(A&& x) -> t<std::remove_cvref_t<A>> {
+      return in_place::pure(std::forward<A>(x));
+    }
+
+    static constexpr RawState<getter<S>> get{};
+
+    template <typename SS>
+    static constexpr auto put(SS&& s) {
+      return RawState{putter<S>{std::forward<SS>(s)}};
+    }
+
+    template <typename F>
+    static constexpr auto modify(F&& f) {
+      return in_place::modify(std::forward<F>(f));
+    }
+
+    template <typename P>
+    static constexpr auto gets(P&& projection) {
+      return in_place::gets(std::forward<P>(projection));
+    }
+  };
+}  // namespace toby::state::in_place
+
+namespace std::experimental {
+  template <typename FTC, typename S, typename A>
+  struct type_constructor<toby::state::in_place::State<FTC, S, A>>
+      : meta::id<toby::state::in_place::StateTC<FTC, S>> {};
+
+  namespace type_constructible {
+    template <typename FTC, typename S, typename A>
+    struct traits<toby::state::in_place::State<FTC, S, A>> {
+      template <typename M, typename X>
+      static auto make(X&& x) {
+        return toby::state::in_place::StateTC<FTC, S>::pure(
+            std::forward<X>(x));
+      }
+    };
+  }  // namespace type_constructible
+
+  namespace functor {
+    template <typename FTC, typename S>
+    struct traits<toby::state::in_place::StateTC<FTC, S>> : mcd_transform {
+      template <typename M, typename F>
+      static auto transform(M&& x, F&& f) -> toby::state::in_place::
+          State<FTC, S, invoke_result_t<F, value_type_t<remove_cvref_t<M>>>> {
+        return toby::state::in_place::transform(std::forward<M>(x),
+                                                std::forward<F>(f));
+      }
+    };
+  }  // namespace functor
+
+  namespace monad {
+    template <typename FTC, typename S>
+    struct traits<toby::state::in_place::StateTC<FTC, S>> : mcd_bind {
+      template <typename M, typename F>
+      static auto bind(M&& x, F&& f) -> toby::state::in_place::State<
+          FTC,
+          S,
+          value_type_t<invoke_result_t<F, value_type_t<remove_cvref_t<M>>>>> {
+        return toby::state::in_place::bind(std::forward<M>(x),
+                                           std::forward<F>(f));
+      }
+    };
+  }  // namespace monad
+}  // namespace std::experimental
+
+namespace std::experimental {
+  // This makes in_place::State<FTC, S, A> useable as a coroutine return type.
+  template <typename FTC, typename S, typename A, typename... Args>
+  struct coroutine_traits<toby::state::in_place::State<FTC, S, A>, Args...> {
+    using promise_type = monad_promise<toby::state::in_place::State<FTC, S, A>>;
+  };
+}  // namespace std::experimental
+
+// As for the by-value State, a RawState can be co_awaited without being
+// type-erased first.
+template <typename FTC, typename S, typename A, typename F>
+struct direct_bind_traits<toby::state::in_place::State<FTC, S, A>,
+                          toby::state::in_place::RawState<F>> {
+  using value_type =
+      std::remove_cvref_t<decltype(std::declval<F>()(std::declval<S&>()))>;
+
+  template <typename K>
+  static auto bind(toby::state::in_place::RawState<F>&& x, K&& k) {
+    return toby::state::in_place::bind(std::move(x), std::forward<K>(k));
+  }
+};
+
+#endif  // STATE_IN_PLACE_H
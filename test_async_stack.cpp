@@ -0,0 +1,144 @@
+#include "async_stack.h"
+#include "function_tc.h"
+#include "result.h"
+#include "state.h"
+
+#include "catch.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using toby::result;
+using toby::async_stack::async_frame;
+
+// These tests are built into their own executable, with TOBY_ASYNC_STACK
+// defined.
+static_assert(toby::async_stack::enabled);
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  using frames = std::vector<async_frame>;
+
+  // A value whose bind records the logical stack, as a sampling profiler would
+  // if it interrupted the bind.
+  struct probe {
+    frames* seen;
+  };
+}  // namespace
+
+template <typename T>
+struct direct_bind_traits<result<T, error>, probe> {
+  using value_type = int;
+
+  template <typename K>
+  static result<T, error> bind(probe p, K&& k) {
+    *p.seen = toby::async_stack::stack();
+    return std::forward<K>(k)(0);
+  }
+};
+
+namespace {
+  unsigned const probe_line = __LINE__ + 4;
+
+  result<frames, error> inner(frames* seen) {
+    co_await result<int, error>(1);
+    co_await probe{seen};
+    co_return toby::async_stack::stack();
+  }
+
+  result<frames, error> outer(frames* seen) {
+    auto s = co_await inner(seen);
+    co_return s;
+  }
+}  // namespace
+
+TEST_CASE("async stack of nested coroutines") {
+  CHECK(toby::async_stack::current() == nullptr);
+  frames seen;
+  auto r = outer(&seen);
+  REQUIRE(r);
+  CHECK(toby::async_stack::current() == nullptr);
+
+  // While inner runs, it is called from outer, which is still running.
+  auto& running = *r;
+  REQUIRE(running.size() == 2);
+  CHECK(!running[0].awaiting);
+  CHECK(running[0].site.line == probe_line);
+  CHECK(std::string(running[0].site.function).find("inner") !=
+        std::string::npos);
+  CHECK(!running[1].awaiting);
+  CHECK(running[0].frame != running[1].frame);
+
+  // While inner is in a bind, it is awaiting at that co_await.
+  REQUIRE(seen.size() == 2);
+  CHECK(seen[0].awaiting);
+  CHECK(seen[0].site.line == probe_line);
+  CHECK(seen[0].frame == running[0].frame);
+  CHECK(seen[1].frame == running[1].frame);
+}
+
+namespace {
+  result<std::string, error> printed(std::size_t* captured) {
+    co_await result<int, error>(1);
+    async_frame buffer[1];
+    *captured = toby::async_stack::capture(buffer, 1);
+    std::ostringstream os;
+    toby::async_stack::print(os);
+    co_return os.str();
+  }
+
+  result<std::string, error> outer_printed(std::size_t* captured) {
+    co_return co_await printed(captured);
+  }
+}  // namespace
+
+TEST_CASE("async stack capture and print") {
+  std::size_t captured = 0;
+  auto r = outer_printed(&captured);
+  REQUIRE(r);
+  // capture is bounded by the size of the buffer.
+  CHECK(captured == 1);
+  CHECK(r->find(" running from ") != std::string::npos);
+  CHECK(r->find("test_async_stack.cpp:") != std::string::npos);
+}
+
+namespace {
+  using IntState = toby::state::StateTC<OneShotFunctionTC, int>;
+
+  IntState::t<std::size_t> state_inner() {
+    co_await toby::state::modify([](int s) { return s + 1; });
+    co_return toby::async_stack::stack().size();
+  }
+
+  IntState::t<std::size_t> state_outer() {
+    auto depth = co_await state_inner();
+    co_return depth;
+  }
+}  // namespace
+
+TEST_CASE("async stack of a running State coroutine") {
+  auto r = state_outer().run(0);
+  CHECK(r.state == 1);
+  // inner is running; what it was called from depends on how the State was
+  // run, but it is never empty.
+  CHECK(r.data >= 1);
+  CHECK(toby::async_stack::current() == nullptr);
+}
+
+TEST_CASE("async stack is restored when a bind throws") {
+  REQUIRE(toby::async_stack::current() == nullptr);
+  toby::async_stack::awaiting<> awaitable(toby::call_site::current());
+  int frame = 0;
+  try {
+    auto in_bind = awaitable.enter(&frame);
+    CHECK(toby::async_stack::current() == awaitable.entry());
+    throw std::runtime_error("bind");
+  } catch (std::runtime_error const&) {
+  }
+  CHECK(toby::async_stack::current() == nullptr);
+}
@@ -0,0 +1,67 @@
+#include "batch.h"
+
+#include "catch.hpp"
+
+namespace {
+  // A linear congruential generator, written generically so that it can be run
+  // on a single state or on a batch of them.
+  auto const next_random = toby::state::get >>= [](auto s) {
+    return toby::state::put(s * 1103515245u + 12345u) >>=
+           [=](auto&&) { return toby::state::pure((s >> 16) & 0x7fffu); };
+  };
+
+  auto const next_random_thrice = next_random >>= [](auto x) {
+    return next_random >>= [=](auto y) {
+      return toby::state::transform(next_random, [=](auto z) {
+        return toby::select(x + y > z, x + y - z, z - x - y);
+      });
+    };
+  };
+
+  std::vector<unsigned> seeds(std::size_t n) {
+    std::vector<unsigned> r;
+    for (std::size_t i = 0; i < n; ++i) r.push_back(unsigned(i * 7919));
+    return r;
+  }
+}  // namespace
+
+TEST_CASE("batch arithmetic") {
+  auto a = toby::batch<int, 4>{{1, 2, 3, 4}};
+  auto b = a * 2 + 1;
+  CHECK(b[0] == 3);
+  CHECK(b[3] == 9);
+  b -= a;
+  CHECK(b[3] == 5);
+  auto c = toby::select(a > 2, a, -a);
+  CHECK(c[1] == -2);
+  CHECK(c[2] == 3);
+}
+
+TEST_CASE("batches of a width that isn't a power of two") {
+  static_assert(alignof(toby::batch<double, 6>) == 64);
+  auto states = seeds(10);
+  auto r = toby::state::run_batch<3>(next_random_thrice, states);
+  for (std::size_t i = 0; i < states.size(); ++i) {
+    CHECK(r.data[i] == next_random_thrice.run(states[i]).data);
+  }
+}
+
+TEST_CASE("run_batch agrees with run") {
+  auto states = seeds(37);
+  auto r = toby::state::run_batch<8>(next_random_thrice, states);
+  REQUIRE(r.data.size() == states.size());
+  REQUIRE(r.state.size() == states.size());
+  for (std::size_t i = 0; i < states.size(); ++i) {
+    auto expected = next_random_thrice.run(states[i]);
+    CHECK(r.data[i] == expected.data);
+    CHECK(r.state[i] == expected.state);
+  }
+}
+
+TEST_CASE("run_batch with a scalar result") {
+  auto st = toby::state::modify([](auto s) { return s + 1.5; }) >>=
+            [](auto&&) { return toby::state::pure(42); };
+  auto r = toby::state::run_batch(st, std::vector<double>{1.0, 2.0, 3.0});
+  CHECK((r.data == std::vector<int>{42, 42, 42}));
+  CHECK((r.state == std::vector<double>{2.5, 3.5, 4.5}));
+}
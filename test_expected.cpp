@@ -1,16 +1,9 @@
-#include <experimental/expected.hpp>
-
-#include "monad_promise.h"
+#include "expected.h"
 
 #include "catch.hpp"
 
-// This makes expected<T, E> useable as a coroutine return type.
-namespace std::experimental {
-  template <typename T, typename E, typename... Args>
-  struct coroutine_traits<expected<T, E>, Args...> {
-    using promise_type = monad_promise<expected<T, E>>;
-  };
-}  // namespace std::experimental
+#include <exception>
+#include <stdexcept>
 
 using std::experimental::expected;
 using std::experimental::make_unexpected;
@@ -103,3 +96,97 @@ TEST_CASE("await error") {
   REQUIRE(!r.valid());
   REQUIRE(r.error().code == 42);
 }
+
+namespace {
+  struct copy_counter {
+    int* copies;
+
+    copy_counter(int* copies) : copies(copies) {}
+    copy_counter(copy_counter const& other) : copies(other.copies) {
+      ++*copies;
+    }
+    copy_counter(copy_counter&&) = default;
+    copy_counter& operator=(copy_counter const&) = delete;
+  };
+}  // namespace
+
+TEST_CASE("await lvalue yields a reference") {
+  int copies = 0;
+  expected<copy_counter, error> config(copy_counter{&copies});
+  auto r = [&]() -> expected<int, error> {
+    auto const& c = co_await config;
+    REQUIRE(&c == &*config);
+    co_return *c.copies;
+  }();
+  REQUIRE(r.valid());
+  CHECK(r.value() == 0);
+  CHECK(copies == 0);
+}
+
+TEST_CASE("await lvalue error") {
+  expected<int, error> e(make_unexpected(error{42}));
+  auto r = [&]() -> expected<int, error> {
+    auto const& x = co_await e;
+    FAIL();
+    co_return x;
+  }();
+  REQUIRE(!r.valid());
+  REQUIRE(r.error().code == 42);
+}
+
+TEST_CASE("fused bind chain") {
+  auto twice = [](int x) -> expected<int, error> { return 2 * x; };
+  auto check = [](int x) -> expected<int, error> {
+    if (x > 10) return make_unexpected(error{x});
+    return x;
+  };
+  int steps = 0;
+  auto counted = [&](auto f) {
+    return [&steps, f](int x) {
+      ++steps;
+      return f(x);
+    };
+  };
+
+  auto chain =
+      ((f1() >>= counted(twice)) >>= counted(check)) >>= counted(twice);
+  static_assert(is_bind_expr<decltype(chain)>::value);
+  CHECK(steps == 0);
+  auto r = std::move(chain).eval();
+  REQUIRE(!r.valid());
+  CHECK(r.error().code == 14);
+  CHECK(steps == 2);
+
+  expected<int, error> r2 =
+      (expected<int, error>(2) >>= counted(twice)) >>= counted(check);
+  REQUIRE(r2.valid());
+  CHECK(*r2 == 4);
+}
+
+// Only the expecteds that opt in convert exceptions; the rest terminate, and
+// so never throw from unhandled_exception.
+template <typename M>
+constexpr bool terminates_on_exception = noexcept(
+    std::declval<monad_promise<M>&>().unhandled_exception());
+static_assert(terminates_on_exception<expected<int, error>>);
+static_assert(!terminates_on_exception<expected<int, std::exception_ptr>>);
+
+TEST_CASE("exceptions converted to an expected's error") {
+  auto divide = [](int x, int y) -> expected<int, std::exception_ptr> {
+    auto a = co_await expected<int, std::exception_ptr>(x);
+    if (y == 0) throw std::domain_error("division by zero");
+    co_return a / y;
+  };
+  auto caller = [&](int x, int y) -> expected<int, std::exception_ptr> {
+    auto q = co_await divide(x, y);
+    co_return q + 1;
+  };
+  auto r = caller(6, 3);
+  REQUIRE(r);
+  CHECK(*r == 3);
+
+  auto e = caller(6, 0);
+  REQUIRE(!e);
+  CHECK_THROWS_AS(std::rethrow_exception(e.error()),
+                  std::domain_error const&);
+}
@@ -0,0 +1,75 @@
+#include "frame_census.h"
+#include "maybe.h"
+#include "result.h"
+
+#include "catch.hpp"
+
+#include <array>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using toby::result;
+
+// These tests are built into their own executable, with TOBY_FRAME_CENSUS
+// defined.
+static_assert(toby::frame_census::enabled);
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  result<int, error> small_frame(int x) {
+    auto y = co_await result<int, error>(x);
+    co_return y + 1;
+  }
+
+  // Its frame holds an awaitable with storage for a large value.
+  result<int, error> large_frame(int x) {
+    auto a = co_await result<std::array<int, 256>, error>(
+        std::array<int, 256>{{x}});
+    co_return a[0];
+  }
+
+  std::optional<int> maybe_frame(int const* p) {
+    auto x = co_await p;
+    co_return x;
+  }
+
+  toby::frame_census::entry find(char const* function) {
+    for (auto const& e : toby::frame_census::report()) {
+      if (std::string(e.function.function) == function) return e;
+    }
+    return {};
+  }
+}  // namespace
+
+TEST_CASE("frame census counts frames by coroutine function") {
+  auto small_before = find("small_frame").frames;
+  auto large_before = find("large_frame").frames;
+  for (int i = 0; i < 3; ++i) CHECK(*small_frame(i) == i + 1);
+  std::thread([] { CHECK(*large_frame(4) == 4); }).join();
+  int x = 5;
+  CHECK(maybe_frame(&x) == 5);
+
+  auto small = find("small_frame");
+  auto large = find("large_frame");
+  CHECK(small.frames - small_before == 3);
+  CHECK(large.frames - large_before == 1);
+  CHECK(small.bytes == small.frames * small.frame_size);
+  CHECK(large.frame_size > 256 * sizeof(int));
+  CHECK(large.frame_size > small.frame_size);
+  CHECK(std::string(small.function.file).find("test_frame_census.cpp") !=
+        std::string::npos);
+  CHECK(find("maybe_frame").frames >= 1);
+
+  // The largest totals come first.
+  auto report = toby::frame_census::report();
+  REQUIRE(report.size() >= 3);
+  CHECK(report[0].bytes >= report[1].bytes);
+
+  std::ostringstream os;
+  toby::frame_census::print(os);
+  CHECK(os.str().find("large_frame") != std::string::npos);
+}
@@ -0,0 +1,115 @@
+#include "latency.h"
+#include "result.h"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+using toby::result;
+
+// These tests are built into their own executable, with TOBY_LATENCY defined.
+static_assert(toby::latency::enabled);
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  // A value whose bind takes a while to call its continuation, as if it were
+  // waiting for I/O.
+  struct slow {
+    int value;
+  };
+}  // namespace
+
+template <typename T>
+struct direct_bind_traits<result<T, error>, slow> {
+  using value_type = int;
+
+  template <typename K>
+  static result<T, error> bind(slow x, K&& k) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return std::forward<K>(k)(x.value);
+  }
+};
+
+namespace {
+  unsigned const fast_line = __LINE__ + 5;
+  unsigned const slow_line = __LINE__ + 5;
+
+  result<int, error> mixed() {
+    // These lines are referred to above.
+    auto a = co_await result<int, error>(1);
+    auto b = co_await slow{2};
+    co_return a + b;
+  }
+
+  toby::latency::site_histogram const* find(
+      std::vector<toby::latency::site_histogram> const& sites,
+      unsigned line) {
+    auto it = std::find_if(sites.begin(), sites.end(), [&](auto const& s) {
+      return s.site.line == line &&
+             std::string(s.site.file).find("test_latency.cpp") !=
+                 std::string::npos;
+    });
+    return it == sites.end() ? nullptr : &*it;
+  }
+}  // namespace
+
+TEST_CASE("call sites compare their files by name") {
+  // Distinct arrays, as the same name may be in different translation units.
+  char const a[] = "file.cpp";
+  char const b[] = "file.cpp";
+  toby::call_site x{a, 10, "f"};
+  toby::call_site y{b, 10, "f"};
+  CHECK(x == y);
+  CHECK(toby::call_site_hash()(x) == toby::call_site_hash()(y));
+  CHECK(!(x == toby::call_site{a, 11, "f"}));
+  CHECK(!(x == toby::call_site{"other.cpp", 10, "f"}));
+  CHECK(!(x == toby::call_site{}));
+  CHECK(toby::call_site{} == toby::call_site{});
+}
+
+TEST_CASE("histogram buckets") {
+  using toby::latency::histogram;
+  for (std::uint64_t ns : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull,
+                           123456789ull, ~0ull}) {
+    auto i = histogram::bucket(ns);
+    CHECK(i < histogram::bucket_count);
+    CHECK(histogram::upper_bound(i) >= ns);
+    // Within one part in 16.
+    CHECK(histogram::upper_bound(i) - ns <= ns / 16);
+  }
+
+  histogram h;
+  for (std::uint64_t ns = 1; ns <= 1000; ++ns) {
+    ++h.counts[histogram::bucket(ns)];
+  }
+  CHECK(h.count() == 1000);
+  CHECK(h.percentile(0.5) >= 500);
+  CHECK(h.percentile(0.5) <= 500 + 500 / 16);
+  CHECK(h.percentile(1.0) >= 1000);
+}
+
+TEST_CASE("co_await latency is recorded by call site") {
+  for (int i = 0; i < 5; ++i) CHECK(*mixed() == 3);
+  std::thread([] { CHECK(*mixed() == 3); }).join();
+
+  auto sites = toby::latency::dump();
+  auto fast = find(sites, fast_line);
+  auto slow = find(sites, slow_line);
+  REQUIRE(fast);
+  REQUIRE(slow);
+  CHECK(fast->samples.count() == 6);
+  CHECK(slow->samples.count() == 6);
+  CHECK(slow->samples.percentile(0.5) >= 2000000);
+  CHECK(fast->samples.percentile(0.5) < slow->samples.percentile(0.5));
+
+  std::ostringstream os;
+  toby::latency::print(os);
+  CHECK(os.str().find("test_latency.cpp:" + std::to_string(slow_line)) !=
+        std::string::npos);
+}
@@ -0,0 +1,121 @@
+#include "lens.h"
+#include "state.h"
+#include "state_in_place.h"
+
+#include "function_tc.h"
+
+#include "catch.hpp"
+
+namespace {
+  struct random_state {
+    int next_value;
+
+    friend bool operator==(random_state lhs, random_state rhs) {
+      return lhs.next_value == rhs.next_value;
+    }
+  };
+
+  // Counts how many times it is copied, to check that zooming in on one part of
+  // an aggregate does not copy the rest of it.
+  struct copy_counter {
+    int* copies;
+
+    copy_counter(int* copies) : copies(copies) {}
+    copy_counter(copy_counter const& other) : copies(other.copies) {
+      ++*copies;
+    }
+    copy_counter(copy_counter&&) = default;
+    copy_counter& operator=(copy_counter const& other) {
+      copies = other.copies;
+      ++*copies;
+      return *this;
+    }
+    copy_counter& operator=(copy_counter&&) = default;
+  };
+
+  struct world {
+    random_state rng;
+    copy_counter rest;
+  };
+
+  using RngState = toby::state::StateTC<OneShotFunctionTC, random_state>;
+  using WorldState = toby::state::StateTC<OneShotFunctionTC, world>;
+
+  auto const next_random = toby::state::get >>= [](random_state s) {
+    return toby::state::put(random_state{s.next_value + 1}) >>=
+           [=](auto&&) { return toby::state::pure(s.next_value); };
+  };
+
+  auto next_random_co() -> RngState::t<int> {
+    auto s = co_await RngState::get;
+    co_await RngState::put(random_state{s.next_value + 1});
+    co_return s.next_value;
+  }
+}  // namespace
+
+TEST_CASE("with_focus member pointer") {
+  random_state s{7};
+  toby::with_focus(&random_state::next_value, s, [](int& x) { x = 42; });
+  CHECK(s == random_state{42});
+}
+
+TEST_CASE("with_focus view lens") {
+  auto l = toby::make_lens([](world& w) -> random_state& { return w.rng; });
+  int copies = 0;
+  world w{{7}, {&copies}};
+  toby::with_focus(l, w, [](random_state& s) { s.next_value = 42; });
+  CHECK(w.rng == random_state{42});
+  CHECK(copies == 0);
+}
+
+TEST_CASE("with_focus getter and setter lens") {
+  auto l = toby::make_lens(
+      [](random_state const& s) { return s.next_value * 2; },
+      [](random_state& s, int x) { s.next_value = x / 2; });
+  random_state s{7};
+  auto r = toby::with_focus(l, s, [](int& x) {
+    CHECK(x == 14);
+    x = 84;
+    return 'r';
+  });
+  CHECK(r == 'r');
+  CHECK(s == random_state{42});
+}
+
+TEST_CASE("zoom raw") {
+  int copies = 0;
+  auto st = toby::state::zoom(&world::rng, next_random) >>= [](int x) {
+    return toby::state::zoom(&world::rng, next_random) >>=
+           [=](int y) { return toby::state::pure(std::pair{x, y}); };
+  };
+  auto r = std::move(st).run(world{{7}, {&copies}});
+  CHECK(r.data == std::pair(7, 8));
+  CHECK(r.state.rng == random_state{9});
+  CHECK(copies == 0);
+}
+
+TEST_CASE("zoom coroutine") {
+  int copies = 0;
+  auto st = []() -> WorldState::t<int> {
+    auto x = co_await toby::state::zoom(&world::rng, next_random_co());
+    auto y = co_await toby::state::zoom(&world::rng, next_random_co());
+    co_return x + y;
+  }();
+  auto r = std::move(st).run(world{{7}, {&copies}});
+  CHECK(r.data == 15);
+  CHECK(r.state.rng == random_state{9});
+  CHECK(copies == 0);
+}
+
+TEST_CASE("zoom in place") {
+  namespace ip = toby::state::in_place;
+  int copies = 0;
+  world w{{7}, {&copies}};
+  auto st = ip::zoom(&world::rng, ip::modify([](random_state& s) {
+                       ++s.next_value;
+                     }));
+  st.run(w);
+  st.run(w);
+  CHECK(w.rng == random_state{9});
+  CHECK(copies == 0);
+}
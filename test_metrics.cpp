@@ -0,0 +1,95 @@
+#include "maybe.h"
+#include "metrics.h"
+#include "result.h"
+
+#include "catch.hpp"
+
+#include <thread>
+
+using toby::fail;
+using toby::result;
+using toby::metrics::snapshot_of;
+
+// These tests are built into their own executable, with TOBY_METRICS defined.
+// Counts are cumulative, so each test compares them before and after.
+static_assert(toby::metrics::enabled);
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  result<int, error> step(int x) {
+    if (x < 0) return fail(error{x});
+    return x + 1;
+  }
+
+  result<int, error> chain(int x) {
+    auto a = co_await step(x);
+    auto b = co_await step(a);
+    co_return co_await step(b);
+  }
+
+  struct threaded {};
+
+  std::optional<threaded> maybe_threaded(int const* p) {
+    co_await p;
+    co_return threaded{};
+  }
+}  // namespace
+
+TEST_CASE("metrics count frames, binds and suspends") {
+  auto before = snapshot_of<result<int, error>>();
+  CHECK(*chain(0) == 3);
+  auto after = snapshot_of<result<int, error>>();
+
+  CHECK(after.frames - before.frames == 1);
+  CHECK(after.frame_bytes > before.frame_bytes);
+  CHECK(after.binds - before.binds == 3);
+  CHECK(after.resumes - before.resumes == 3);
+  // One suspend per co_await, and one at the final suspend point.
+  CHECK(after.suspends - before.suspends == 4);
+  CHECK(after.short_circuits == before.short_circuits);
+  CHECK(after.frames_reclaimed - before.frames_reclaimed == 1);
+  CHECK(after.max_depth >= 1);
+}
+
+TEST_CASE("metrics count short circuits") {
+  auto before = snapshot_of<result<int, error>>();
+  CHECK(!chain(-5));
+  auto after = snapshot_of<result<int, error>>();
+
+  CHECK(after.frames - before.frames == 1);
+  CHECK(after.binds - before.binds == 1);
+  CHECK(after.resumes == before.resumes);
+  CHECK(after.short_circuits - before.short_circuits == 1);
+  CHECK(after.frames_reclaimed - before.frames_reclaimed == 1);
+}
+
+TEST_CASE("metrics count nulls awaited in maybe coroutines") {
+  int x = 0;
+  auto before = snapshot_of<std::optional<threaded>>();
+  CHECK(maybe_threaded(&x));
+  CHECK(!maybe_threaded(nullptr));
+  auto after = snapshot_of<std::optional<threaded>>();
+
+  CHECK(after.frames - before.frames == 2);
+  CHECK(after.binds - before.binds == 2);
+  CHECK(after.short_circuits - before.short_circuits == 1);
+}
+
+TEST_CASE("metrics of exited threads are kept") {
+  int x = 0;
+  auto before = snapshot_of<std::optional<threaded>>();
+  std::thread t([&] {
+    for (int i = 0; i < 10; ++i) maybe_threaded(i % 2 ? &x : nullptr);
+  });
+  t.join();
+  auto after = snapshot_of<std::optional<threaded>>();
+
+  CHECK(after.frames - before.frames == 10);
+  CHECK(after.short_circuits - before.short_circuits == 5);
+
+  auto total = toby::metrics::total();
+  CHECK(total.frames >= after.frames);
+}
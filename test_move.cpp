@@ -0,0 +1,215 @@
+#include "expected.h"
+#include "maybe.h"
+#include "monad_promise.h"
+#include "state.h"
+#include "state_in_place.h"
+
+#include "function_tc.h"
+
+#include "catch.hpp"
+
+#include <memory>
+
+using std::experimental::expected;
+
+namespace {
+  struct counts {
+    int copies = 0;
+    int moves = 0;
+  };
+
+  // A payload that counts how many times it has been copied and moved.
+  struct counted {
+    counts* c;
+    int value;
+
+    counted(counts* c, int value) : c(c), value(value) {}
+    counted(counted const& other) : c(other.c), value(other.value) {
+      ++c->copies;
+    }
+    counted(counted&& other) noexcept : c(other.c), value(other.value) {
+      ++c->moves;
+    }
+    counted& operator=(counted const& other) {
+      c = other.c;
+      value = other.value;
+      ++c->copies;
+      return *this;
+    }
+    counted& operator=(counted&& other) noexcept {
+      c = other.c;
+      value = other.value;
+      ++c->moves;
+      return *this;
+    }
+  };
+
+  struct error {
+    int code;
+  };
+
+  using IntState = toby::state::StateTC<OneShotFunctionTC, int>;
+
+  auto maybe_counted(counts* c) -> std::optional<counted> {
+    auto x = co_await std::optional<counted>(counted{c, 1});
+    x.value += 1;
+    co_return std::move(x);
+  }
+
+  auto maybe_unique() -> std::optional<std::unique_ptr<int>> {
+    auto p = co_await std::optional(std::make_unique<int>(1));
+    ++*p;
+    co_return std::move(p);
+  }
+
+  // Records how many moves the co_await made, before the co_return makes
+  // more.
+  auto expected_rvalue(expected<counted, error>&& e, int* await_moves)
+      -> expected<counted, error> {
+    auto x = co_await std::move(e);
+    *await_moves = x.c->moves;
+    x.value += 1;
+    co_return std::move(x);
+  }
+
+  auto expected_lvalue_reference(expected<counted, error> const& e)
+      -> expected<int, error> {
+    auto const& x = co_await e;
+    co_return x.value + 1;
+  }
+
+  auto expected_lvalue_copy(expected<counted, error> const& e)
+      -> expected<counted, error> {
+    auto x = co_await e;
+    x.value += 1;
+    co_return std::move(x);
+  }
+
+  auto state_counted(counts* c) -> IntState::t<counted> {
+    auto x = co_await toby::state::pure(counted{c, 1});
+    auto s = co_await toby::state::get;
+    x.value += s;
+    co_return std::move(x);
+  }
+
+  auto state_unique() -> IntState::t<std::unique_ptr<int>> {
+    auto p = co_await toby::state::pure(std::make_unique<int>(1));
+    co_await toby::state::modify([](int s) { return s + 1; });
+    co_return std::move(p);
+  }
+
+  auto state_unique_twice() -> IntState::t<std::unique_ptr<int>> {
+    auto p = co_await state_unique();
+    auto q = co_await state_unique();
+    *p += *q;
+    co_return std::move(p);
+  }
+}  // namespace
+
+TEST_CASE("maybe moves its payload") {
+  counts c;
+  auto r = maybe_counted(&c);
+  REQUIRE(r);
+  CHECK(r->value == 2);
+  CHECK(c.copies == 0);
+}
+
+TEST_CASE("maybe with a move-only payload") {
+  auto r = maybe_unique();
+  REQUIRE(r);
+  CHECK(**r == 2);
+}
+
+TEST_CASE("expected moves its payload when awaited as an rvalue") {
+  counts c;
+  expected<counted, error> e = counted{&c, 1};
+  c = counts{};
+  int await_moves = -1;
+  auto r = expected_rvalue(std::move(e), &await_moves);
+  REQUIRE(r);
+  CHECK(r->value == 2);
+  CHECK(c.copies == 0);
+  // co_await moves the expected into the awaitable's parameter and from there
+  // into its member; bind hands the continuation a reference to the value,
+  // which it moves into the awaitable's result, and await_resume moves it out
+  // as the value of the co_await.
+  CHECK(await_moves == 4);
+  // co_return moves the value into a new expected, emplace_value moves that
+  // into the storage of the continuation, which returns it to bind by moving
+  // it, await_suspend moves bind's result into the return object's stage, and
+  // the caller gets the return object by moving it out of the stage.
+  CHECK(c.moves - await_moves == 5);
+}
+
+TEST_CASE("expected awaited as an lvalue") {
+  counts c;
+  expected<counted, error> const e = counted{&c, 1};
+  c = counts{};
+
+  auto r = expected_lvalue_reference(e);
+  REQUIRE(r);
+  CHECK(*r == 2);
+  CHECK(c.copies == 0);
+  CHECK(c.moves == 0);
+
+  // The one copy is of the referenced value into x, and the moves are those
+  // of the co_return, as in the rvalue case.
+  auto r2 = expected_lvalue_copy(e);
+  REQUIRE(r2);
+  CHECK(r2->value == 2);
+  CHECK(e->value == 1);
+  CHECK(c.copies == 1);
+  CHECK(c.moves == 5);
+}
+
+TEST_CASE("pure raw moves its payload when run as an rvalue") {
+  counts c;
+  auto r = toby::state::pure(counted{&c, 1}).run(0);
+  CHECK(r.data.value == 1);
+  CHECK(c.copies == 0);
+
+  auto m = toby::state::pure(counted{&c, 2});
+  auto r2 = m.run(0);
+  CHECK(r2.data.value == 2);
+  CHECK(c.copies == 1);
+}
+
+TEST_CASE("bind raw moves its payload") {
+  counts c;
+  auto m = toby::state::pure(counted{&c, 1}) >>= [](counted x) {
+    x.value += 1;
+    return toby::state::pure(std::move(x));
+  };
+  auto r = std::move(m).run(0);
+  CHECK(r.data.value == 2);
+  CHECK(c.copies == 0);
+}
+
+TEST_CASE("State coroutine moves its payload") {
+  counts c;
+  auto r = state_counted(&c).run(7);
+  CHECK(r.data.value == 8);
+  CHECK(r.state == 7);
+  CHECK(c.copies == 0);
+}
+
+TEST_CASE("State coroutine with a move-only payload") {
+  auto r = state_unique_twice().run(0);
+  REQUIRE(r.data);
+  CHECK(*r.data == 2);
+  CHECK(r.state == 2);
+}
+
+TEST_CASE("in place pure with a move-only payload") {
+  namespace ip = toby::state::in_place;
+  auto m = ip::pure(std::make_unique<int>(3)) >>= [](std::unique_ptr<int> p) {
+    return ip::modify([](int& s) { ++s; }) >>=
+           [p = std::move(p)](auto&&) mutable {
+             return ip::pure(std::move(p));
+           };
+  };
+  auto r = ip::run(std::move(m), 0);
+  REQUIRE(r.data);
+  CHECK(*r.data == 3);
+  CHECK(r.state == 1);
+}
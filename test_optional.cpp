@@ -2,6 +2,12 @@
 
 #include "catch.hpp"
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
 template <template <typename> class Monad, typename T>
 Monad<T> non_coroutine_pure(T&& x) {
   return {std::forward<T>(x)};
@@ -49,3 +55,136 @@ TEST_CASE("coroutine empty") {
   auto result = doblock2<std::optional>().value_or(42);
   REQUIRE(result == 42);
 }
+
+TEST_CASE("co_await lvalue yields a reference") {
+  std::optional<std::string> config("large");
+  auto result = [&]() -> std::optional<bool> {
+    auto& s = co_await config;
+    s += " config";
+    auto const& cs = co_await std::as_const(config);
+    co_return &cs == &*config;
+  }();
+  REQUIRE(result);
+  CHECK(*result);
+  CHECK(*config == "large config");
+}
+
+TEST_CASE("co_await optional reference_wrapper") {
+  int x = 1;
+  auto result = [&]() -> std::optional<int> {
+    int& r = co_await std::optional(std::ref(x));
+    r = 2;
+    co_return r;
+  }();
+  REQUIRE(result);
+  CHECK(*result == 2);
+  CHECK(x == 2);
+}
+
+namespace {
+  std::unordered_map<std::string, int> const table{{"one", 1}, {"two", 2}};
+
+  // A lookup in the style of a hash table find that returns null if there is
+  // no entry.
+  int const* find(std::string const& key) {
+    auto it = table.find(key);
+    return it == table.end() ? nullptr : &it->second;
+  }
+
+  std::optional<int> sum(std::string const& a, std::string const& b) {
+    auto& x = co_await find(a);
+    auto& y = co_await find(b);
+    co_return x + y;
+  }
+
+  // A user-defined nullable type that isn't pointer-like.
+  struct lookup_result {
+    bool found;
+    int value;
+  };
+}  // namespace
+
+template <>
+struct nullable_traits<lookup_result> {
+  static bool has_value(lookup_result const& r) { return r.found; }
+  static int const& value(lookup_result const& r) { return r.value; }
+  static int take(lookup_result&& r) { return r.value; }
+};
+
+TEST_CASE("co_await raw pointer") {
+  CHECK(sum("one", "two") == 3);
+  CHECK(sum("one", "three") == std::nullopt);
+}
+
+TEST_CASE("co_await pointer yields a reference to the pointee") {
+  auto result = []() -> std::optional<bool> {
+    auto& x = co_await find("one");
+    co_return &x == &table.at("one");
+  }();
+  CHECK(result == true);
+}
+
+TEST_CASE("co_await unique_ptr") {
+  auto result = []() -> std::optional<std::string> {
+    std::string s = co_await std::make_unique<std::string>("moved");
+    auto p = std::make_unique<std::string>(" and referred to");
+    auto& r = co_await p;
+    co_return s + r;
+  }();
+  CHECK(result == "moved and referred to");
+
+  auto empty = []() -> std::optional<int> {
+    co_await std::unique_ptr<int>();
+    FAIL();
+    co_return 0;
+  }();
+  CHECK(empty == std::nullopt);
+}
+
+TEST_CASE("co_await shared_ptr copies the shared value") {
+  auto shared = std::make_shared<std::string>("shared");
+  auto result = [&]() -> std::optional<std::string> {
+    auto s = co_await std::shared_ptr<std::string>(shared);
+    co_return s;
+  }();
+  CHECK(result == "shared");
+  CHECK(*shared == "shared");
+}
+
+TEST_CASE("co_await user-defined nullable") {
+  auto result = [](lookup_result a, lookup_result b) -> std::optional<int> {
+    auto x = co_await a;
+    auto y = co_await std::move(b);
+    co_return x + y;
+  };
+  CHECK(result({true, 1}, {true, 2}) == 3);
+  CHECK(result({true, 1}, {false, 2}) == std::nullopt);
+}
+
+namespace {
+  struct parsed {
+    int value;
+  };
+}  // namespace
+
+// Coroutines returning an optional<parsed> return nullopt for any exception.
+template <>
+struct exception_traits<std::optional<parsed>> {
+  static constexpr exception_policy policy = exception_policy::convert;
+
+  static std::optional<parsed> from_exception(std::exception_ptr) {
+    return std::nullopt;
+  }
+};
+
+TEST_CASE("exceptions converted to an empty optional") {
+  auto scale = [](std::string const& key,
+                  std::string const& text) -> std::optional<parsed> {
+    auto& n = co_await find(key);
+    co_return parsed{n * std::stoi(text)};
+  };
+  REQUIRE(scale("two", "21"));
+  CHECK(scale("two", "21")->value == 42);
+  CHECK(!scale("three", "21"));
+  CHECK(!scale("two", "twenty-one"));
+}
@@ -0,0 +1,137 @@
+#include "persistent.h"
+
+#include "catch.hpp"
+
+#include <map>
+#include <string>
+
+using toby::persistent::map;
+using toby::persistent::vector;
+
+namespace {
+  // A hash that sends every key to one of a few buckets, so that the map has to
+  // deal with collisions.
+  struct bad_hash {
+    std::size_t operator()(int x) const { return std::size_t(x % 3); }
+  };
+}  // namespace
+
+TEST_CASE("persistent vector push_back and index") {
+  vector<int> v;
+  for (int i = 0; i < 5000; ++i) v = v.push_back(i);
+  REQUIRE(v.size() == 5000);
+  for (int i = 0; i < 5000; ++i) REQUIRE(v[i] == i);
+  CHECK_THROWS_AS(v.at(5000), std::out_of_range const&);
+}
+
+TEST_CASE("persistent vector updates leave snapshots unchanged") {
+  vector<int> v;
+  for (int i = 0; i < 2000; ++i) v = std::move(v).push_back(i);
+  auto snapshot = v;
+  auto v2 = v.set(1500, -1).push_back(2000);
+  CHECK(v2[1500] == -1);
+  CHECK(v2.size() == 2001);
+  CHECK(snapshot[1500] == 1500);
+  CHECK(snapshot.size() == 2000);
+  CHECK(v[1500] == 1500);
+  auto v3 = std::move(v2).update(7, [](int x) { return x * 10; });
+  CHECK(v3[7] == 70);
+  CHECK(snapshot[7] == 7);
+}
+
+TEST_CASE("persistent vector transient") {
+  auto t = vector<std::string>().make_transient();
+  for (int i = 0; i < 100; ++i) t.push_back(std::to_string(i));
+  t.set(42, "forty-two");
+  auto v = std::move(t).persistent();
+  CHECK(v.size() == 100);
+  CHECK(v[41] == "41");
+  CHECK(v[42] == "forty-two");
+}
+
+TEST_CASE("persistent map set, find and erase") {
+  map<int, int> m;
+  for (int i = 0; i < 3000; ++i) m = m.set(i, i * i);
+  REQUIRE(m.size() == 3000);
+  for (int i = 0; i < 3000; ++i) REQUIRE(m.at(i) == i * i);
+  CHECK(m.find(3000) == nullptr);
+
+  auto snapshot = m;
+  for (int i = 0; i < 3000; i += 2) m = std::move(m).erase(i);
+  CHECK(m.size() == 1500);
+  CHECK_FALSE(m.contains(0));
+  CHECK(m.at(1) == 1);
+  CHECK(snapshot.size() == 3000);
+  CHECK(snapshot.at(0) == 0);
+
+  m = m.erase(12345);
+  CHECK(m.size() == 1500);
+}
+
+TEST_CASE("persistent map with colliding hashes") {
+  map<int, std::string, bad_hash> m;
+  for (int i = 0; i < 20; ++i) m = m.set(i, std::to_string(i));
+  CHECK(m.size() == 20);
+  for (int i = 0; i < 20; ++i) CHECK(m.at(i) == std::to_string(i));
+  auto m2 = m.erase(3).set(4, "four");
+  CHECK(m2.size() == 19);
+  CHECK_FALSE(m2.contains(3));
+  CHECK(m2.at(4) == "four");
+  CHECK(m.at(3) == "3");
+  CHECK(m.at(4) == "4");
+}
+
+TEST_CASE("persistent map agrees with std::map") {
+  map<int, int> m;
+  std::map<int, int> reference;
+  unsigned x = 12345;
+  for (int i = 0; i < 5000; ++i) {
+    x = x * 1103515245 + 12345;
+    int key = int(x >> 16) % 1000;
+    if (x & 1) {
+      m = std::move(m).set(key, i);
+      reference[key] = i;
+    } else {
+      m = std::move(m).erase(key);
+      reference.erase(key);
+    }
+  }
+  REQUIRE(m.size() == reference.size());
+  std::map<int, int> contents;
+  m.for_each([&](int k, int v) { contents[k] = v; });
+  CHECK(contents == reference);
+}
+
+TEST_CASE("persistent map transient") {
+  auto t = map<std::string, int>().make_transient();
+  t.set("a", 1);
+  t.set("b", 2);
+  t.update("a", [](int const* v) { return v ? *v + 10 : 0; });
+  t.erase("b");
+  auto m = std::move(t).persistent();
+  CHECK(m.size() == 1);
+  CHECK(m.at("a") == 11);
+}
+
+TEST_CASE("persistent containers as State") {
+  using toby::state::get_at;
+  using toby::state::put_at;
+  using toby::state::update_at;
+  auto count = [](int const* v) { return v ? *v + 1 : 1; };
+  auto st = put_at(std::string("x"), 1) >>= [=](auto&&) {
+    return update_at(std::string("x"), count) >>= [=](auto&&) {
+      return update_at(std::string("y"), count) >>=
+             [](auto&&) { return get_at(std::string("x")); };
+    };
+  };
+  map<std::string, int> initial;
+  auto r = st.run(initial);
+  CHECK(r.data == std::optional<int>(2));
+  CHECK(r.state.size() == 2);
+  CHECK(r.state.at("y") == 1);
+  CHECK(initial.empty());
+
+  auto r2 = toby::state::push_back(3).run(vector<int>().push_back(1));
+  CHECK(r2.state.size() == 2);
+  CHECK(r2.state[1] == 3);
+}
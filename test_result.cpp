@@ -0,0 +1,182 @@
+#include "result.h"
+
+#include "catch.hpp"
+
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using toby::fail;
+using toby::result;
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  result<int, error> f1() { return 7; }
+  result<double, error> f2(int x) { return 2.0 * x; }
+  result<int, error> f3(int, double) { return fail(error{42}); }
+
+  // A payload whose copies throw while armed is set. Its move constructor
+  // doesn't throw, but isn't noexcept unless NothrowMove is true.
+  template <bool NothrowMove>
+  struct throwing_copy {
+    int value;
+    bool const* armed;
+
+    throwing_copy(int value, bool const* armed) : value(value), armed(armed) {}
+    throwing_copy(throwing_copy const& other)
+        : value(other.value), armed(other.armed) {
+      if (*armed) throw std::runtime_error("copy");
+    }
+    throwing_copy(throwing_copy&& other) noexcept(NothrowMove)
+        : value(other.value), armed(other.armed) {}
+    throwing_copy& operator=(throwing_copy const& other) {
+      if (*other.armed) throw std::runtime_error("copy");
+      value = other.value;
+      armed = other.armed;
+      return *this;
+    }
+    throwing_copy& operator=(throwing_copy&&) = default;
+  };
+
+  template <bool NothrowMove>
+  void check_assignment_that_throws() {
+    using R = result<throwing_copy<NothrowMove>, std::string>;
+    bool armed = false;
+    R const value = throwing_copy<NothrowMove>{1, &armed};
+    R const other_value = throwing_copy<NothrowMove>{2, &armed};
+    R r = fail(std::string("error"));
+    armed = true;
+
+    CHECK_THROWS_AS(r = value, std::runtime_error const&);
+    REQUIRE(!r);
+    CHECK(r.error() == "error");
+
+    armed = false;
+    r = value;
+    armed = true;
+    CHECK_THROWS_AS(r = other_value, std::runtime_error const&);
+    REQUIRE(r);
+    CHECK(r->value == 1);
+
+    r = R(fail(std::string("error")));
+    REQUIRE(!r);
+    CHECK(r.error() == "error");
+  }
+
+  result<int, error> test_result_coroutine() {
+    auto x = co_await f1();
+    auto y = co_await f2(x);
+    auto z = co_await f3(x, y);
+    co_return z;
+  }
+}  // namespace
+
+static_assert(std::is_trivially_copyable_v<result<int, error>>);
+static_assert(std::is_trivially_copyable_v<result<double, error>>);
+static_assert(!std::is_trivially_copyable_v<result<std::string, error>>);
+static_assert(sizeof(result<int, error>) == 2 * sizeof(int));
+
+TEST_CASE("result value and error") {
+  auto r = f1();
+  REQUIRE(r.has_value());
+  CHECK(*r == 7);
+  CHECK(r.value() == 7);
+
+  auto e = f3(1, 2.0);
+  REQUIRE(!e);
+  CHECK(e.error().code == 42);
+  CHECK_THROWS(e.value());
+}
+
+TEST_CASE("result bind and map") {
+  auto r = f1().bind(f2).map([](double y) { return y + 1; });
+  REQUIRE(r);
+  CHECK(*r == 15.0);
+
+  auto e = f1().bind([](int x) { return f3(x, 0.0); }).bind(f2);
+  REQUIRE(!e);
+  CHECK(e.error().code == 42);
+}
+
+TEST_CASE("result coroutine") {
+  auto r = test_result_coroutine();
+  REQUIRE(!r);
+  CHECK(r.error().code == 42);
+
+  auto good = []() -> result<double, error> {
+    auto x = co_await f1();
+    auto y = co_await f2(x);
+    co_return x + y;
+  }();
+  REQUIRE(good);
+  CHECK(*good == 21.0);
+}
+
+TEST_CASE("result co_return failure") {
+  auto r = []() -> result<int, error> {
+    co_await f1();
+    co_return fail(error{3});
+  }();
+  REQUIRE(!r);
+  CHECK(r.error().code == 3);
+}
+
+TEST_CASE("result with non-trivial payloads") {
+  result<std::string, std::string> a = std::string("value");
+  auto b = a;
+  CHECK(*b == "value");
+  result<std::string, std::string> c = fail(std::string("error"));
+  b = c;
+  REQUIRE(!b);
+  CHECK(b.error() == "error");
+  b = std::move(a);
+  REQUIRE(b);
+  CHECK(*b == "value");
+
+  auto p = []() -> result<std::unique_ptr<int>, error> {
+    auto q = co_await result<std::unique_ptr<int>, error>(
+        std::make_unique<int>(5));
+    co_return std::move(q);
+  }();
+  REQUIRE(p);
+  CHECK(**p == 5);
+}
+
+TEST_CASE("result assignment that throws leaves the old contents") {
+  check_assignment_that_throws<true>();
+  check_assignment_that_throws<false>();
+}
+
+TEST_CASE("co_await lvalue result yields a reference") {
+  result<std::string, error> config = std::string("config");
+  auto r = [&]() -> result<bool, error> {
+    auto const& s = co_await config;
+    co_return &s == &*config;
+  }();
+  REQUIRE(r);
+  CHECK(*r);
+}
+
+TEST_CASE("exceptions converted to a result's error") {
+  auto divide = [](int x, int y) -> result<int, std::exception_ptr> {
+    auto a = co_await result<int, std::exception_ptr>(x);
+    if (y == 0) throw std::domain_error("division by zero");
+    co_return a / y;
+  };
+  auto caller = [&](int x, int y) -> result<int, std::exception_ptr> {
+    auto q = co_await divide(x, y);
+    co_return q + 1;
+  };
+  auto r = caller(6, 3);
+  REQUIRE(r);
+  CHECK(*r == 3);
+
+  auto e = caller(6, 0);
+  REQUIRE(!e);
+  CHECK_THROWS_AS(std::rethrow_exception(e.error()),
+                  std::domain_error const&);
+}
@@ -0,0 +1,117 @@
+#include "sample.h"
+
+#include "catch.hpp"
+
+#include <functional>
+#include <stdexcept>
+
+namespace {
+  using toby::sample::rng;
+  using toby::sample::sample;
+
+  auto in_unit_circle() -> sample<bool> {
+    auto x = co_await toby::sample::uniform;
+    auto y = co_await toby::sample::uniform;
+    co_return x * x + y * y <= 1.0;
+  }
+
+  auto const in_unit_circle_raw = toby::sample::uniform >>= [](double x) {
+    return toby::state::transform(
+        toby::sample::uniform, [=](double y) { return x * x + y * y <= 1.0; });
+  };
+
+  struct moments {
+    std::size_t n = 0;
+    double sum = 0.0;
+    double sum_of_squares = 0.0;
+
+    double mean() const { return sum / double(n); }
+    double variance() const {
+      return sum_of_squares / double(n) - mean() * mean();
+    }
+  };
+
+  moments add(moments m, double x) {
+    return {m.n + 1, m.sum + x, m.sum_of_squares + x * x};
+  }
+
+  moments join(moments a, moments b) {
+    return {a.n + b.n, a.sum + b.sum, a.sum_of_squares + b.sum_of_squares};
+  }
+}  // namespace
+
+TEST_CASE("philox4x32_10 known answers") {
+  // From the Random123 known-answer tests.
+  auto r = toby::sample::philox4x32_10({0, 0, 0, 0}, {0, 0});
+  CHECK((r == std::array<std::uint32_t, 4>{
+                  {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}));
+  r = toby::sample::philox4x32_10(
+      {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+      {0xa4093822, 0x299f31d0});
+  CHECK((r == std::array<std::uint32_t, 4>{
+                  {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}));
+}
+
+TEST_CASE("sampling advances the generator") {
+  auto r = in_unit_circle().run(rng::for_sample(1, 2));
+  CHECK((r.state == rng{1, 2, 2}));
+  CHECK(r.data == in_unit_circle_raw.run(rng::for_sample(1, 2)).data);
+}
+
+TEST_CASE("uniform_int stays within its bounds") {
+  auto d = toby::sample::uniform_int(-3, 3);
+  auto s = rng::for_sample(7, 0);
+  bool seen[7] = {};
+  for (int i = 0; i < 1000; ++i) {
+    auto r = d.run(s);
+    REQUIRE(r.data >= -3);
+    REQUIRE(r.data <= 3);
+    seen[r.data + 3] = true;
+    s = r.state;
+  }
+  CHECK(std::all_of(std::begin(seen), std::end(seen),
+                    [](bool b) { return b; }));
+}
+
+TEST_CASE("normal has the requested moments") {
+  auto m = toby::sample::run_parallel(toby::sample::normal(2.0, 3.0), 100000,
+                                      42, moments{}, add, join);
+  CHECK(m.n == 100000);
+  CHECK(m.mean() == Approx(2.0).margin(0.05));
+  CHECK(m.variance() == Approx(9.0).epsilon(0.02));
+}
+
+TEST_CASE("run_parallel estimates pi") {
+  auto hits = toby::sample::run_parallel(
+      in_unit_circle, 10000, 1, std::size_t(0),
+      [](std::size_t n, bool hit) { return n + hit; }, std::plus<>{});
+  CHECK(4.0 * double(hits) / 10000 == Approx(3.1416).margin(0.05));
+}
+
+TEST_CASE("run_parallel is reproducible across thread counts") {
+  auto run = [](unsigned threads) {
+    return toby::sample::run_parallel(toby::sample::normal(), 50000, 9,
+                                      moments{}, add, join, threads);
+  };
+  auto one = run(1);
+  for (unsigned threads : {2u, 3u, 8u}) {
+    auto many = run(threads);
+    CHECK(many.n == one.n);
+    CHECK(many.sum == one.sum);
+    CHECK(many.sum_of_squares == one.sum_of_squares);
+  }
+}
+
+TEST_CASE("run_parallel rethrows an exception from a sample") {
+  auto fails = [](std::size_t n, double x) {
+    if (x > 3.0) throw std::range_error("too far out");
+    return n + 1;
+  };
+  for (unsigned threads : {1u, 4u}) {
+    CHECK_THROWS_AS(
+        toby::sample::run_parallel(toby::sample::normal(), 50000, 3,
+                                   std::size_t(0), fails, std::plus<>{},
+                                   threads),
+        std::range_error const&);
+  }
+}
@@ -1,7 +1,11 @@
 #include "state.h"
 
+#include "function_tc.h"
+
 #include "catch.hpp"
 
+#include <memory>
+
 namespace stde = std::experimental;
 
 struct random_state {
@@ -12,55 +16,20 @@ struct random_state {
   }
 };
 
-template <typename R, typename... A>
-struct OneShotFunction {
-  struct IInvoker {
-    virtual ~IInvoker() = default;
-    virtual R invoke(A...) && = 0;
-  };
-
-  template <typename F>
-  struct Invoker : IInvoker {
-    F f;
-
-    template <typename G>
-    Invoker(G&& f) : f(std::forward<G>(f)) {}
-
-    R invoke(A... args) && override { return std::move(f)(args...); }
-  };
-
-  std::shared_ptr<IInvoker> invoker;
-
-  template <typename F>
-  OneShotFunction(F&& f)
-      : invoker(std::make_shared<Invoker<std::remove_cvref_t<F>>>(
-            std::forward<F>(f))) {}
-
-  auto operator()(A... args) && { return std::move(*invoker).invoke(args...); }
-};
-
-struct OneShotFunctionTC {
-  template <typename R, typename... A>
-  using invoke = OneShotFunction<R, A...>;
-};
+using MyState = toby::state::StateTC<StdFunctionTC, random_state>;
+using MyStateOneShot = toby::state::StateTC<OneShotFunctionTC, random_state>;
 
-struct StdFunctionTC {
-  template <typename R, typename... A>
-  using invoke = std::function<R(A...)>;
+// A state whose State opts in to fusing chains of >>=, to check that a fused
+// chain survives a bind that keeps its continuation and calls it later.
+struct fused_state {
+  int total;
 };
 
-namespace std::experimental::type_constructible {
-  template <>
-  struct traits<StdFunctionTC> {
-    template <typename R, typename... A, typename F>
-    static auto make(F&& f) {
-      return std::function<R(A...)>(std::forward<F>(f));
-    }
-  };
-}  // namespace std::experimental::type_constructible
+template <typename A>
+struct fuses_binds<toby::state::State<StdFunctionTC, fused_state, A>>
+    : std::true_type {};
 
-using MyState = toby::state::StateTC<StdFunctionTC, random_state>;
-using MyStateOneShot = toby::state::StateTC<OneShotFunctionTC, random_state>;
+using FusedState = toby::state::StateTC<StdFunctionTC, fused_state>;
 
 auto random(random_state s) -> std::pair<double, random_state> {
   return {static_cast<double>(s.next_value), {s.next_value + 1}};
@@ -80,6 +49,64 @@ auto const next_random_co = []() -> MyStateOneShot::t<double> {
   co_return v;
 };
 
+auto const next_random_raw_co = []() -> MyStateOneShot::t<double> {
+  auto rs = co_await toby::state::get;
+  auto [v, rs2] = random(rs);
+  auto _ = co_await toby::state::put(rs2);
+  co_return v;
+};
+
+namespace constant {
+  namespace ts = toby::state;
+
+  struct counter {
+    int value;
+    int steps;
+  };
+
+  constexpr auto tick = ts::gets(&counter::value) >>= [](int v) {
+    return ts::modify([](counter c) {
+             return counter{c.value * 3 % 7, c.steps + 1};
+           }) >>= [=](auto&&) { return ts::pure(v); };
+  };
+
+  constexpr auto ticks = ts::replicate<4>(tick);
+
+  static_assert(ts::pure(2).run(1).data == 2);
+  static_assert(ts::get.run(3).data == 3);
+  static_assert(ts::put(4).run(3).state == 4);
+  static_assert(
+      ts::transform(ts::get, [](int x) { return x + 1; }).run(3).data == 4);
+  static_assert(tick.run(counter{1, 0}).data == 1);
+  static_assert(tick.run(counter{1, 0}).state.value == 3);
+  static_assert(ticks.run(counter{1, 0}).data[3] == 6);
+  static_assert(ticks.run(counter{1, 0}).state.steps == 4);
+  static_assert(ts::zoom(&counter::steps, ts::put(9)).run(counter{1, 0})
+                    .state.steps == 9);
+
+  // The table for the CRC-32 of the IEEE 802.3 polynomial, generated by a State
+  // program whose state is the index of the next entry.
+  constexpr std::uint32_t crc32_entry(std::uint32_t n) {
+    for (int k = 0; k < 8; ++k) n = n & 1 ? 0xEDB88320u ^ (n >> 1) : n >> 1;
+    return n;
+  }
+
+  constexpr auto crc32_table =
+      ts::replicate<256>(ts::gets(crc32_entry) >>= [](std::uint32_t entry) {
+        return ts::modify([](std::uint32_t n) { return n + 1; }) >>=
+               [=](auto&&) { return ts::pure(entry); };
+      }).run(std::uint32_t(0)).data;
+
+  static_assert(crc32_table[1] == 0x77073096u);
+  static_assert(crc32_table[255] == 0x2D02EF8Du);
+}  // namespace constant
+
+TEST_CASE("replicate") {
+  auto r = constant::ticks.run(constant::counter{1, 0});
+  CHECK((r.data == std::array<int, 4>{{1, 3, 2, 6}}));
+  CHECK(r.state.value == 4);
+}
+
 TEST_CASE("pure raw") {
   auto r = toby::state::pure(2.3).run(random_state{7});
   CHECK(r.data == 2.3);
@@ -117,6 +144,34 @@ TEST_CASE("put type-erased") {
   CHECK(r.state == random_state{42});
 }
 
+TEST_CASE("modify raw") {
+  auto r = toby::state::modify([](random_state s) {
+             return random_state{s.next_value * 2};
+           }).run(random_state{7});
+  CHECK(r.data == toby::state::unit{});
+  CHECK(r.state == random_state{14});
+}
+
+TEST_CASE("gets raw") {
+  auto r = toby::state::gets(&random_state::next_value).run(random_state{7});
+  CHECK(r.data == 7);
+  CHECK(r.state == random_state{7});
+}
+
+TEST_CASE("state primitives are not type-erased") {
+  static_assert(std::is_same_v<decltype(MyState::get),
+                               toby::state::RawState<
+                                   toby::state::getter<random_state>> const>);
+  auto st = MyState::gets(&random_state::next_value) >>= [](int x) {
+    return MyState::modify([=](random_state s) {
+      return random_state{s.next_value + x};
+    });
+  };
+  auto r = st.run(random_state{7});
+  CHECK(r.data == toby::state::unit{});
+  CHECK(r.state == random_state{14});
+}
+
 TEST_CASE("fmap raw") {
   auto st = toby::state::pure(4.2);
   auto st2 =
@@ -169,6 +224,13 @@ TEST_CASE("next_random_co transform") {
   CHECK(r.state == random_state{8});
 }
 
+TEST_CASE("next_random_raw_co") {
+  auto st = next_random_raw_co();
+  auto r = std::move(st).run({7});
+  CHECK(r.data == 7.0);
+  CHECK(r.state == random_state{8});
+}
+
 TEST_CASE("running a coroutine-based state twice throws an exception") {
   auto st = next_random_co();
   auto r = std::move(st).run({7});
@@ -200,3 +262,24 @@ TEST_CASE("next_random_co_thrice") {
   CHECK(r.data == std::make_tuple(7.0, 8.0, 9.0));
   CHECK(r.state == random_state{10});
 }
+
+TEST_CASE("a fused chain outlives its bind_expr and can be run twice") {
+  auto add = [](int n) {
+    // The shared_ptr is null once moved from.
+    return [n = std::make_shared<int>(n)](int x) -> FusedState::t<int> {
+      return FusedState::modify([x](fused_state s) {
+        return fused_state{s.total + x};
+      }) >>= [v = x + *n](auto&&) { return FusedState::pure(v); };
+    };
+  };
+
+  auto chain = (FusedState::pure(1) >>= add(10)) >>= add(100);
+  static_assert(is_bind_expr<decltype(chain)>::value);
+  FusedState::t<int> st = std::move(chain);
+
+  for (int run = 0; run < 2; ++run) {
+    auto r = st.run({0});
+    CHECK(r.data == 111);
+    CHECK(r.state.total == 12);
+  }
+}
@@ -0,0 +1,104 @@
+#include "state_in_place.h"
+
+#include "function_tc.h"
+
+#include "catch.hpp"
+
+namespace stde = std::experimental;
+namespace ip = toby::state::in_place;
+
+namespace {
+  struct random_state {
+    int next_value;
+
+    friend bool operator==(random_state lhs, random_state rhs) {
+      return lhs.next_value == rhs.next_value;
+    }
+  };
+
+  using MyState = ip::StateTC<StdFunctionTC, random_state>;
+  using MyStateOneShot = ip::StateTC<OneShotFunctionTC, random_state>;
+
+  MyState::t<int> const next_random =
+      MyState::gets(&random_state::next_value) >>= [](int v) {
+        return MyState::modify([](random_state& s) { ++s.next_value; }) >>=
+               [=](auto&&) { return MyState::pure(v); };
+      };
+
+  auto const next_random_co = []() -> MyStateOneShot::t<int> {
+    auto rs = co_await MyState::get;
+    co_await MyState::put(random_state{rs.next_value + 1});
+    co_return rs.next_value;
+  };
+}  // namespace
+
+namespace constant {
+  constexpr auto bump = ip::gets([](int x) { return x * 2; }) >>= [](int v) {
+    return ip::modify([](int& x) { ++x; }) >>=
+           [=](auto&&) { return ip::pure(v); };
+  };
+
+  static_assert(ip::run(bump, 5).data == 10);
+  static_assert(ip::run(bump, 5).state == 6);
+  static_assert(ip::run(ip::put(3), 5).state == 3);
+}  // namespace constant
+
+TEST_CASE("in place pure raw") {
+  random_state s{7};
+  CHECK(ip::pure(2.3).run(s) == 2.3);
+  CHECK(s == random_state{7});
+}
+
+TEST_CASE("in place get raw") {
+  random_state s{7};
+  CHECK(ip::get.run(s) == random_state{7});
+  CHECK(s == random_state{7});
+}
+
+TEST_CASE("in place put raw") {
+  random_state s{7};
+  CHECK(ip::put(random_state{42}).run(s) == toby::state::unit{});
+  CHECK(s == random_state{42});
+}
+
+TEST_CASE("in place modify raw") {
+  random_state s{7};
+  ip::modify([](random_state& s) { s.next_value *= 2; }).run(s);
+  CHECK(s == random_state{14});
+  ip::modify([](random_state s) { return random_state{s.next_value + 1}; })
+      .run(s);
+  CHECK(s == random_state{15});
+}
+
+TEST_CASE("in place gets raw") {
+  random_state s{7};
+  CHECK(ip::gets(&random_state::next_value).run(s) == 7);
+}
+
+TEST_CASE("in place fmap type-erased") {
+  auto st = ip::StateTC<StdFunctionTC, int>::pure(4.2);
+  auto st2 =
+      stde::functor::transform(st, [](auto x) { return std::to_string(x); });
+  auto r = ip::run(st2, 7);
+  CHECK(r.data == std::to_string(4.2));
+  CHECK(r.state == 7);
+}
+
+TEST_CASE("in place next_random") {
+  random_state s{7};
+  CHECK(next_random.run(s) == 7);
+  CHECK(next_random.run(s) == 8);
+  CHECK(s == random_state{9});
+}
+
+TEST_CASE("in place next_random_co_thrice") {
+  auto st = []() -> MyStateOneShot::t<std::tuple<int, int, int>> {
+    auto x = co_await next_random_co();
+    auto y = co_await next_random_co();
+    auto z = co_await next_random_co();
+    co_return std::make_tuple(x, y, z);
+  }();
+  auto r = ip::run(std::move(st), random_state{7});
+  CHECK(r.data == std::make_tuple(7, 8, 9));
+  CHECK(r.state == random_state{10});
+}
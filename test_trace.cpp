@@ -0,0 +1,101 @@
+#include "result.h"
+#include "trace.h"
+
+#include "catch.hpp"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+using toby::fail;
+using toby::result;
+
+// These tests are built into their own executable, with TOBY_TRACE defined.
+static_assert(toby::trace::enabled);
+
+namespace {
+  struct error {
+    int code;
+  };
+
+  result<int, error> step(int x) {
+    if (x < 0) return fail(error{x});
+    return x + 1;
+  }
+
+  result<int, error> chain(int x) {
+    auto a = co_await step(x);
+    co_return co_await step(a);
+  }
+
+  std::size_t count(std::string const& s, std::string const& what) {
+    std::size_t n = 0;
+    for (auto i = s.find(what); i != std::string::npos;
+         i = s.find(what, i + 1)) {
+      ++n;
+    }
+    return n;
+  }
+}  // namespace
+
+TEST_CASE("trace records the life of a frame") {
+  toby::trace::clear();
+  CHECK(*chain(0) == 2);
+
+  std::vector<toby::trace::event> events;
+  toby::trace::detail::local().for_each(
+      [&](toby::trace::record_type const& r) { events.push_back(r.what); });
+
+  using toby::trace::event;
+  CHECK((events == std::vector<event>{event::create,
+                                      event::suspend,
+                                      event::bind,
+                                      event::resume,
+                                      event::suspend,
+                                      event::bind,
+                                      event::resume,
+                                      event::return_value,
+                                      event::suspend,
+                                      event::destroy}));
+}
+
+TEST_CASE("trace exports Chrome trace-event JSON") {
+  toby::trace::clear();
+  CHECK(*chain(0) == 2);
+  CHECK(!chain(-1));
+
+  std::ostringstream os;
+  toby::trace::write_chrome_trace(os);
+  auto json = os.str();
+  CHECK(json.rfind("{\"traceEvents\":[", 0) == 0);
+  CHECK(json.find("\n]}") != std::string::npos);
+  // Each frame is an async slice from its creation to its destruction.
+  CHECK(count(json, "\"name\":\"frame\",\"cat\":\"coroutine\",\"ph\":\"b\"") ==
+        2);
+  CHECK(count(json, "\"name\":\"frame\",\"cat\":\"coroutine\",\"ph\":\"e\"") ==
+        2);
+  CHECK(count(json, "\"name\":\"bind\"") == 3);
+}
+
+TEST_CASE("rings of exited threads are kept until they are reused") {
+  auto rings = [] {
+    return toby::trace::detail::registry::access(
+        [](auto const& set, auto const&) { return set.rings.size(); });
+  };
+  auto frames = [] {
+    std::ostringstream os;
+    toby::trace::write_chrome_trace(os);
+    return count(os.str(),
+                 "\"name\":\"frame\",\"cat\":\"coroutine\",\"ph\":\"b\"");
+  };
+
+  toby::trace::clear();
+  std::thread([] { chain(0); }).join();
+  auto before = rings();
+  CHECK(frames() == 1);
+
+  for (int i = 0; i < 10; ++i) std::thread([] { chain(0); }).join();
+  CHECK(rings() == before);
+  // Each thread discarded the events of the one before it.
+  CHECK(frames() == 1);
+}
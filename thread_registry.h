@@ -0,0 +1,69 @@
+#ifndef THREAD_REGISTRY_H
+#define THREAD_REGISTRY_H
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace toby {
+  // State that each thread keeps for itself and that other threads read, as
+  // the instrumentation does. The first time a thread calls local() it gets a
+  // Local of its own, which it updates without taking a lock, and which is
+  // registered in live until the thread exits. Then, under the lock,
+  //
+  //   void retire(Retired& retired);
+  //
+  // is called on it to fold what it holds into the state of exited threads.
+  // Distinct Tags give a thread distinct Locals, such as one per monad type.
+  template <typename Local, typename Retired>
+  class thread_registry {
+   public:
+    template <typename Tag = void, typename... Args>
+    static Local& local(Args&&... args) {
+      thread_local registration r(std::forward<Args>(args)...);
+      return r.local;
+    }
+
+    // Calls f(retired, live) under the lock and returns what it returns. The
+    // Locals in live belong to running threads, so f may only read them, and
+    // only as far as they allow.
+    template <typename F>
+    static decltype(auto) access(F&& f) {
+      auto& r = instance();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      return std::forward<F>(f)(r.retired, r.live);
+    }
+
+   private:
+    std::mutex mutex;
+    std::vector<Local*> live;
+    Retired retired;
+
+    static thread_registry& instance() {
+      static thread_registry r;
+      return r;
+    }
+
+    struct registration {
+      Local local;
+
+      template <typename... Args>
+      explicit registration(Args&&... args)
+          : local(std::forward<Args>(args)...) {
+        auto& r = instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(&local);
+      }
+
+      ~registration() {
+        auto& r = instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        local.retire(r.retired);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &local));
+      }
+    };
+  };
+}  // namespace toby
+
+#endif  // THREAD_REGISTRY_H
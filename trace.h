@@ -0,0 +1,209 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(TOBY_TRACE)
+#include "thread_registry.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <vector>
+#endif
+
+/*!
+= Trace
+
+When TOBY_TRACE is defined, monad_promise and monad_awaitable record the life of
+each coroutine frame: its creation, every suspension, resumption and bind, its
+co_return and its destruction, each with a timestamp and the address of the
+frame.
+
+Each thread records into a ring buffer of its own that holds the most recent
+TOBY_TRACE_CAPACITY events, 65536 by default, so recording takes no lock.
+`write_chrome_trace()` writes the events of all threads, including those that
+have exited, as Chrome trace-event JSON, which chrome://tracing and Perfetto
+display with a bar for the life of each frame and for each time it was
+suspended. It should be called while no coroutines are running, as events
+recorded during the export may be overwritten as they are read.
+
+A ring is some 1.5 MB at the default capacity. When a thread exits its ring is
+kept, with its events, until a thread that starts later needs one: that thread
+then takes it over, discarding the events. There are therefore only ever as
+many rings as there have been threads recording at the same time, however many
+threads a program starts and stops, and the events of exited threads can be
+exported until their rings are reused. The rings are freed only at exit.
+
+When TOBY_TRACE isn't defined, nothing is recorded. Of the functions, only
+`record()` is declared then, so that the ring buffers and the export cost
+nothing to compile. It must be defined, or not, consistently across a program.
+*/
+
+#if !defined(TOBY_TRACE_CAPACITY)
+#define TOBY_TRACE_CAPACITY 65536
+#endif
+
+namespace toby::trace {
+#if defined(TOBY_TRACE)
+  inline constexpr bool enabled = true;
+#else
+  inline constexpr bool enabled = false;
+#endif
+
+  enum class event : std::uint8_t {
+    create,
+    suspend,
+    resume,
+    bind,
+    return_value,
+    destroy,
+  };
+
+  inline char const* name(event e) {
+    switch (e) {
+      case event::create: return "create";
+      case event::suspend: return "suspend";
+      case event::resume: return "resume";
+      case event::bind: return "bind";
+      case event::return_value: return "return_value";
+      case event::destroy: break;
+    }
+    return "destroy";
+  }
+
+  struct record_type {
+    std::uint64_t nanoseconds;
+    void const* frame;
+    event what;
+  };
+
+#if defined(TOBY_TRACE)
+  namespace detail {
+    struct ring {
+      static constexpr std::size_t capacity = TOBY_TRACE_CAPACITY;
+      static_assert((capacity & (capacity - 1)) == 0,
+                    "TOBY_TRACE_CAPACITY must be a power of two");
+
+      unsigned thread;
+      std::array<record_type, capacity> records;
+      // The number of events ever recorded. Only the owning thread writes it.
+      std::atomic<std::uint64_t> head{0};
+      // The number of events discarded by clear, under the registry's lock.
+      std::uint64_t cleared = 0;
+
+      explicit ring(unsigned thread) : thread(thread) {}
+
+      void push(record_type const& r) {
+        auto h = head.load(std::memory_order_relaxed);
+        records[h & (capacity - 1)] = r;
+        head.store(h + 1, std::memory_order_release);
+      }
+
+      // The retained events, oldest first.
+      template <typename F>
+      void for_each(F&& f) const {
+        auto h = head.load(std::memory_order_acquire);
+        auto first = h > capacity ? h - capacity : 0;
+        if (first < cleared) first = cleared;
+        for (auto i = first; i < h; ++i) f(records[i & (capacity - 1)]);
+      }
+    };
+
+    // The rings of every thread. Those of exited threads are free, and are
+    // kept so that their events can still be exported until they are reused.
+    struct ring_set {
+      unsigned next_thread = 1;
+      std::vector<std::unique_ptr<ring>> rings;
+      std::vector<ring*> free;
+    };
+
+    // A thread's use of a ring from the set, which it gives back on exit.
+    struct ring_lease {
+      ring* r;
+
+      ring_lease();
+      void retire(ring_set& set) { set.free.push_back(r); }
+    };
+
+    using registry = thread_registry<ring_lease, ring_set>;
+
+    inline ring_lease::ring_lease()
+        : r(registry::access([](ring_set& set, auto const&) {
+            if (set.free.empty()) {
+              set.rings.push_back(std::make_unique<ring>(set.next_thread++));
+              return set.rings.back().get();
+            }
+            // Nothing writes a free ring, so its events are discarded as clear
+            // does.
+            auto* reused = set.free.back();
+            set.free.pop_back();
+            reused->thread = set.next_thread++;
+            reused->cleared = reused->head.load(std::memory_order_relaxed);
+            return reused;
+          })) {}
+
+    inline ring& local() {
+      return *registry::local().r;
+    }
+  }  // namespace detail
+
+  // Records an event in the life of a coroutine frame on this thread.
+  inline void record(event what, void const* frame) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now().time_since_epoch())
+                  .count();
+    detail::local().push({std::uint64_t(ns), frame, what});
+  }
+
+  // Writes the retained events of every thread as Chrome trace-event JSON.
+  // The life of each frame is an async slice, with the frame's address as its
+  // id, and each suspension a slice nested in it; the other events are
+  // instants within the slice.
+  inline void write_chrome_trace(std::ostream& os) {
+    detail::registry::access([&](detail::ring_set const& set, auto const&) {
+      os << "{\"traceEvents\":[";
+      bool first = true;
+      for (auto const& ring : set.rings) {
+        ring->for_each([&](record_type const& r) {
+          char const* ph = "n";
+          char const* slice = "frame";
+          switch (r.what) {
+            case event::create: ph = "b"; break;
+            case event::destroy: ph = "e"; break;
+            case event::suspend: ph = "b"; slice = "suspended"; break;
+            case event::resume: ph = "e"; slice = "suspended"; break;
+            default: slice = name(r.what); break;
+          }
+          os << (first ? "\n" : ",\n") << "{\"name\":\"" << slice
+             << "\",\"cat\":\"coroutine\",\"ph\":\"" << ph << "\",\"id\":\""
+             << r.frame << "\",\"pid\":1,\"tid\":" << ring->thread
+             << ",\"ts\":" << r.nanoseconds / 1000 << '.';
+          auto fraction = r.nanoseconds % 1000;
+          os << char('0' + fraction / 100) << char('0' + fraction / 10 % 10)
+             << char('0' + fraction % 10) << '}';
+          first = false;
+        });
+      }
+      os << "\n]}\n";
+    });
+  }
+
+  // Discards the events recorded so far by every thread.
+  inline void clear() {
+    detail::registry::access([](detail::ring_set& set, auto const&) {
+      for (auto const& ring : set.rings) {
+        // head is written only by the ring's own thread.
+        ring->cleared = ring->head.load(std::memory_order_acquire);
+      }
+    });
+  }
+#else
+  inline void record(event, void const*) {}
+#endif
+}  // namespace toby::trace
+
+#endif  // TRACE_H